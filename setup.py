@@ -79,6 +79,7 @@ exts = cythonize([
         sources=[
             'src/p4p/_gw.pyx',
             'src/pvxs_gw.cpp',
+            'src/pvxs_gwpy.cpp',
             'src/pvxs_odometer.cpp'
         ],
         include_dirs = get_numpy_include_dirs()+[epicscorelibs.path.include_path, pvxslibs.path.include_path, 'src', 'src/p4p'],
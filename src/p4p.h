@@ -3,6 +3,7 @@
 
 #include <stdexcept>
 #include <sstream>
+#include <vector>
 
 #include <epicsMutex.h>
 #include <epicsGuard.h>
@@ -182,7 +183,18 @@ PyObject* asPySpec(const Value& v, bool fakearray=false);
 
 int except_map();
 PyObject* asPy(const Value& v, bool unpackstruct, bool unpackrecurse, PyObject *wrapper);
+PyObject* asPyColumns(const Value& v);
+PyObject* asPyChanged(const Value& v, PyObject *wrapper);
+PyObject* asPyStack(PyObject* values, const std::string& name);
+PyObject* asPyNDArray(const Value& v);
 void storePy(Value& v, PyObject* py, bool forceCast);
+// As storePy(v, py, true).  When py is a dict, use or add to the assignment plans cached in 'plans'
+void storePyPlanned(Value& v, PyObject* py, PyObject* plans);
+// Position of a sub-field in iall() order, or fieldNoIndex if not a plain sub-field (eg. union member)
+constexpr size_t fieldNoIndex = size_t(-1);
+size_t fieldIndex(const Value& top, const std::string& name);
+// sub-field by position from fieldIndex() for a Value of the same type
+Value fieldAt(const Value& top, size_t index);
 PyObject* tostr(const Value& v, size_t limit=0, bool showval=true);
 
 /******* Server *******/
@@ -216,6 +228,26 @@ PyObject* monPop(const std::shared_ptr<client::Subscription>& mon);
 
 std::shared_ptr<server::Source> makeOdometer(const std::string& name);
 
+/******* synthetic load (testing tool) *******/
+
+struct LoadConfig {
+    // PV names.  "%u" is replaced with PV index [0, count).
+    std::string pattern;
+    size_t count = 1u;
+    // When not empty, serve these PV names instead of pattern and count.
+    std::vector<std::string> names;
+    // "scalar", "waveform", "ndarray", or "table"
+    std::string type = "scalar";
+    // elements of waveform, pixels along each side of ndarray, or rows of table
+    size_t size = 1u;
+    // monitor updates per second, for each PV.  zero for none.
+    double rate = 0.0;
+    // PUT updates and is posted to subscribers.  RPC replies with argument.
+    bool echo = false;
+};
+
+std::shared_ptr<server::Source> makeLoadSource(const LoadConfig& conf);
+
 } // namespace p4p
 
 #endif // P4P_H
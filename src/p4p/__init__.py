@@ -11,7 +11,7 @@ else:
     import epicscorelibs.path
     import pvxslibs.path
 
-from .wrapper import Value, Type
+from .wrapper import Value, Type, FieldRef
 from ._p4p import (version as pvxsVersion, listRefs, logger_level_set as _logger_level_set)
 
 from ._p4p import (logLevelAll, logLevelTrace, logLevelDebug,
@@ -24,6 +24,7 @@ _log = logging.getLogger(__name__)
 __all__ = (
     'Value',
     'Type',
+    'FieldRef',
 )
 
 _lvls = {
@@ -17,6 +17,7 @@ from libcpp.vector cimport vector
 from .pvxs.client cimport Context, Report, ReportInfo
 from .pvxs.server cimport ServerGUID
 from .pvxs.source cimport Source, ChannelControl, OpBase, ClientCredentials
+from .pvxs.data cimport Value
 from . cimport _p4p
 
 cdef extern from "pvxs_gw.h" namespace "p4p" nogil:
@@ -35,19 +36,67 @@ cdef extern from "pvxs_gw.h" namespace "p4p" nogil:
         double get_holdoff
 
     cdef cppclass GWChan:
+        const string dsname
         const shared_ptr[GWUpstream] us
         const shared_ptr[ChannelControl] dschannel
         bool allow_put
         bool allow_rpc
         bool allow_uncached
         bool audit
+        double deadband
+        double reldeadband
+
+    cdef struct GWSlowConsumer:
+        string usname
+        string dsname
+        string peer
+        size_t nQueue
+        size_t limitQueue
+        size_t nSquash
+
+    cdef struct GWCacheEntry:
+        string usname
+        double lastuse
+
+    cdef struct GWSearchDrop:
+        string host
+        size_t nDrop
+
+    cdef cppclass GWShard:
+        Context upstream
+
+    cdef struct GWShardStats:
+        size_t channels
+        size_t connected
+        size_t subscriptions
+        size_t work
+
+    cdef struct GWCacheStats:
+        size_t ccacheSize
+        size_t mcacheSize
+        size_t gcacheSize
+        size_t mcacheBytes
+        size_t gcacheBytes
+        size_t banHostSize
+        size_t banPVSize
+        size_t banHostPVSize
+        size_t searchDrops
+
+    cdef cppclass GWPolicy:
+        pass
+
+    shared_ptr[GWPolicy] makePyPolicy() except+
 
     cdef cppclass GWSource(Source):
         Context upstream
+        vector[shared_ptr[GWShard]] shards
+        shared_ptr[GWPolicy] policy
         PyObject* handler
+        size_t slowLimit
+        size_t cacheBudget
 
         @staticmethod
-        shared_ptr[GWSource] build(const Context&) except+
+        shared_ptr[GWSource] build(const Context&, size_t nshard) except+
 
         int test(const string&) except+
         shared_ptr[GWChan] connect(const string &dsname, const string &usname, unique_ptr[ChannelControl]* op) except+
@@ -56,16 +105,62 @@ cdef extern from "pvxs_gw.h" namespace "p4p" nogil:
         void forceBan(const string& host, const string& usname) except+
         void clearBan() except+
         void cachePeek(setxx[string]& names) except+
+        void cacheSnapshot(vector[GWCacheEntry]& entries) except+
+        void cached(const string& usname, Value& mon, Value& get) except+
+        size_t warm(const vector[string]& names, double timeout) except+
+        void slowConsumers(vector[GWSlowConsumer]& slow) except+
+        void cacheStats(GWCacheStats& stats) except+
+        void record(const string& fname) except+
+        void searchLimit(double rate, double burst) except+
+        void searchDrops(vector[GWSearchDrop]& drops) except+
+        void shardStats(vector[GWShardStats]& stats) except+
 
         shared_ptr[GWSource] shared_from_this() except+
 
     shared_ptr[Source] makeOdometer(const string& name) except+
 
+    cdef cppclass LoadConfig:
+        string pattern
+        size_t count
+        vector[string] names
+        string type
+        size_t size
+        double rate
+        bool echo
+
+    shared_ptr[Source] makeLoadSource(const LoadConfig& conf) except+
+
 def addOdometer(_p4p.Server serv, basestring pvname, int order):
     cdef string name = pvname.encode()
     with nogil:
         serv.serv.addSource(name, makeOdometer(name), order)
 
+def addLoadSource(_p4p.Server serv, basestring pattern, size_t count=1, basestring type='scalar',
+                  size_t size=1, double rate=0.0, bool echo=False, int order=0, names=None):
+    """Serve synthetic load.  count PVs named by replacing "%u" in pattern with an index.
+    Or, if names is given, an iterable of PV names, which are served from one Source
+    and updated by one thread.  pattern then only names the Source.
+
+    type is one of 'scalar', 'waveform' (of size elements), 'ndarray' (of size x size pixels),
+    or 'table' (of size rows).  Monitors are updated rate times per second, or never if zero.
+    With echo=True, PUT updates are posted to subscribers, and RPC replies with its argument.
+    """
+    cdef LoadConfig conf
+    conf.pattern = pattern.encode()
+    conf.count = count
+    conf.type = type.encode()
+    conf.size = size
+    conf.rate = rate
+    conf.echo = echo
+    if names is not None:
+        for pvname in names:
+            conf.names.push_back(pvname.encode())
+        if conf.names.empty():
+            return
+    cdef string name = conf.pattern
+    with nogil:
+        serv.serv.addSource(name, makeLoadSource(conf), order)
+
 cdef class InfoBase(object):
     cdef shared_ptr[const ClientCredentials] info
 
@@ -136,7 +231,24 @@ cdef class Channel(InfoBase):
     def expired(self):
         return self.channel.use_count()<=1
 
-    def access(self, put=None, rpc=None, uncached=None, audit=None, holdoff=None):
+    @property
+    def dsname(self):
+        """Downstream (client-side) name
+        """
+        return self.channel.get().dsname
+
+    def close(self):
+        """Disconnect the downstream client.  It will search again to reconnect.
+        """
+        with nogil:
+            self.channel.get().dschannel.get().close()
+
+    def access(self, put=None, rpc=None, uncached=None, audit=None, holdoff=None, deadband=None, reldeadband=None):
+        """Update permissions and settings of this Channel.
+
+        :param float deadband: Minimum absolute change in NTScalar value of new subscriptions.
+        :param float reldeadband: Minimum change of new subscriptions as a fraction of the last value sent.
+        """
         if put is not None:
             self.channel.get().allow_put = put==True
         if rpc is not None:
@@ -147,6 +259,10 @@ cdef class Channel(InfoBase):
             self.channel.get().audit = audit==True
         if holdoff is not None:
             self.channel.get().us.get().get_holdoff = holdoff
+        if deadband is not None:
+            self.channel.get().deadband = deadband
+        if reldeadband is not None:
+            self.channel.get().reldeadband = reldeadband
 
 @cython.no_gc_clear
 cdef class Provider(_p4p.Source):
@@ -167,7 +283,7 @@ cdef class Provider(_p4p.Source):
         self.BanPV = GWSearchBanPV
         self.BanHostPV = GWSearchBanHostPV
 
-    def __init__(self, unicode name, object client, object handler):
+    def __init__(self, unicode name, object client, object handler, size_t shards=1):
         cdef _p4p.ClientProvider prov = client._ctxt
         cdef string cname = name.encode('utf-8')
         self.name = cname
@@ -175,7 +291,8 @@ cdef class Provider(_p4p.Source):
         if not prov:
             raise ValueError('Not a Context')
         with nogil:
-            self.provider = GWSource.build(prov.ctxt)
+            self.provider = GWSource.build(prov.ctxt, shards)
+            self.provider.get().policy = makePyPolicy()
             self.src = <shared_ptr[Source]>self.provider
 
         Py_INCREF(handler)
@@ -232,13 +349,15 @@ cdef class Provider(_p4p.Source):
     def ignoreByGUID(self, list servers):
         cdef _p4p.Server serv
         cdef vector[ServerGUID] guids
+        cdef size_t i
 
         for ent in servers:
             serv = <_p4p.Server?>ent
             guids.push_back(serv.serv.config().guid)
 
         with nogil:
-            self.provider.get().upstream.ignoreServerGUIDs(guids)
+            for i in range(self.provider.get().shards.size()):
+                self.provider.get().shards[i].get().upstream.ignoreServerGUIDs(guids)
 
     def cachePeek(self):
         """Returns PV names in channel cache
@@ -255,19 +374,173 @@ cdef class Provider(_p4p.Source):
             ret.add(name)
         return ret
 
+    def cacheSnapshot(self):
+        """Returns PV names in channel cache with time of last use, most recent first.
+
+        :returns: List of tuple
+        :rtype: [(usname, lastuse)]
+        """
+        cdef vector[GWCacheEntry] entries
+
+        with nogil:
+            self.provider.get().cacheSnapshot(entries)
+
+        ret = []
+        for ent in entries:
+            ret.append((ent.usname.decode('utf-8', 'replace'), ent.lastuse))
+        return ret
+
+    def cached(self, basestring usname):
+        """Copies of the values cached for an upstream PV.
+        Array fields share storage with the cache.
+
+        :returns: A tuple (subscription, get) of `Value` or None if not cached.
+        """
+        cdef string name = usname.encode()
+        cdef Value mon, get
+
+        with nogil:
+            self.provider.get().cached(name, mon, get)
+
+        return (_p4p.Value_wrap(mon) if mon.valid() else None,
+                _p4p.Value_wrap(get) if get.valid() else None)
+
+    def warm(self, names, double timeout=5.0):
+        """Add upstream PV names to the channel cache, connecting in parallel.
+        eg. from a `cacheSnapshot` saved before restart.
+
+        :param names: An iterable of PV name strings
+        :param float timeout: Maximum time to wait for connections to complete
+        :returns: The number of names connected
+        """
+        cdef vector[string] usnames
+        cdef size_t ret
+
+        for name in names:
+            usnames.push_back(name.encode('utf-8') if isinstance(name, unicode) else name)
+
+        with nogil:
+            ret = self.provider.get().warm(usnames, timeout)
+        return ret
+
+    def slowPolicy(self, unicode policy, unsigned limit=100):
+        """Select handling of downstream subscribers which can not keep up with updates.
+
+        :param unicode policy: 'squash' to always squash updates into the latest value,
+                               or 'disconnect' to close the downstream channel.
+        :param int limit: With 'disconnect', the number of consecutive updates squashed
+                          before the downstream channel is closed.
+        """
+        if policy==u'squash':
+            self.provider.get().slowLimit = 0
+        elif policy==u'disconnect':
+            if limit==0:
+                raise ValueError('disconnect policy requires limit>0')
+            self.provider.get().slowLimit = limit
+        else:
+            raise ValueError('Unknown slow consumer policy %r'%policy)
+
+    def slowConsumers(self):
+        """Return downstream subscribers whose queue is full, or which have had updates squashed.
+
+        :returns: List of tuple
+        :rtype: [(usname, dsname, peer, nQueue, limitQueue, nSquash)]
+        """
+        cdef vector[GWSlowConsumer] slow
+
+        with nogil:
+            self.provider.get().slowConsumers(slow)
+
+        ret = []
+        for ent in slow:
+            ret.append((ent.usname.decode('utf-8', 'replace'), ent.dsname.decode('utf-8', 'replace'),
+                        ent.peer.decode('utf-8', 'replace'), ent.nQueue, ent.limitQueue, ent.nSquash))
+        return ret
+
+    def searchLimit(self, double rate, double burst=0.0):
+        """Limit the rate at which PV names searched for by each client host are considered.
+        Excess searches are dropped before `testChannel` is called.
+
+        :param float rate: Names per second for each host.  Zero for no limit.
+        :param float burst: Names which may be searched for at once.  Zero for max(1, rate).
+        """
+        with nogil:
+            self.provider.get().searchLimit(rate, burst)
+
+    def searchDrops(self):
+        """Return client hosts which have had searches dropped by `searchLimit`.
+
+        :returns: List of tuple
+        :rtype: [(host, nDrop)]
+        """
+        cdef vector[GWSearchDrop] drops
+
+        with nogil:
+            self.provider.get().searchDrops(drops)
+
+        ret = []
+        for ent in drops:
+            ret.append((ent.host.decode('utf-8', 'replace'), ent.nDrop))
+        return ret
+
+    def shardStats(self):
+        """Return load on each upstream client context.  cf. the shards= argument of `Provider`.
+
+        :returns: List of tuple
+        :rtype: [(channels, connected, subscriptions, work)]
+        """
+        cdef vector[GWShardStats] stats
+
+        with nogil:
+            self.provider.get().shardStats(stats)
+
+        ret = []
+        for ent in stats:
+            ret.append((ent.channels, ent.connected, ent.subscriptions, ent.work))
+        return ret
+
+    def cacheBudget(self, size_t nbytes):
+        """Set an approximate limit on memory used to hold cached values.
+        When exceeded, `sweep` discards cached GET values, least recently used first,
+        and removes unused channels immediately.
+
+        :param int nbytes: Limit in bytes.  Zero for no limit.
+        """
+        self.provider.get().cacheBudget = nbytes
+
+    def record(self, fname=None):
+        """Begin capture of downstream workload (searches, channels, and operations) to a file,
+        replacing any previous capture.  cf. `p4p.gwreplay`
+
+        :param str fname: File name, or None to stop capture.
+        """
+        cdef string name
+        if fname is not None:
+            name = fname.encode()
+        with nogil:
+            self.provider.get().record(name)
+
     def stats(self):
-        """Return statistics of various internal caches
+        """Return statistics of various internal caches.
+        Also 'searchDrops', the number of searched names dropped by `searchLimit`.
 
         :rtype: dict
         """
-        # TODO
+        cdef GWCacheStats stats
+
+        with nogil:
+            self.provider.get().cacheStats(stats)
+
         return {
-            'ccacheSize.value':0,
-            'mcacheSize.value':0,
-            'gcacheSize.value':0,
-            'banHostSize.value':0,
-            'banPVSize.value':0,
-            'banHostPVSize.value':0,
+            'ccacheSize.value':stats.ccacheSize,
+            'mcacheSize.value':stats.mcacheSize,
+            'gcacheSize.value':stats.gcacheSize,
+            'mcacheBytes.value':stats.mcacheBytes,
+            'gcacheBytes.value':stats.gcacheBytes,
+            'banHostSize.value':stats.banHostSize,
+            'banPVSize.value':stats.banPVSize,
+            'banHostPVSize.value':stats.banHostPVSize,
+            'searchDrops':stats.searchDrops,
         }
 
     def report(self, float norm=1.0):
@@ -278,14 +551,17 @@ cdef class Provider(_p4p.Source):
         """
         cdef Report report
         cdef double cnorm = norm
-        with nogil:
-            report = self.provider.get().upstream.report()
+        cdef size_t i
 
         usinfo = []
-        for conn in report.connections:
-            peer = conn.peer.decode('utf-8', 'replace')
-            for chan in conn.channels:
-                usinfo.append((chan.name.decode('utf-8', 'replace'), chan.tx/cnorm, chan.rx/cnorm, peer, conn.tx/cnorm, conn.rx/cnorm))
+        for i in range(self.provider.get().shards.size()):
+            with nogil:
+                report = self.provider.get().shards[i].get().upstream.report()
+
+            for conn in report.connections:
+                peer = conn.peer.decode('utf-8', 'replace')
+                for chan in conn.channels:
+                    usinfo.append((chan.name.decode('utf-8', 'replace'), chan.tx/cnorm, chan.rx/cnorm, peer, conn.tx/cnorm, conn.rx/cnorm))
 
         return usinfo
 
@@ -6,6 +6,10 @@ from libcpp.string cimport string
 from pvxs cimport client
 from pvxs cimport source
 from pvxs cimport server
+from pvxs cimport data
+
+# for other extension modules.  eg. _gw
+cdef object Value_wrap(const data.Value& v)
 
 cdef class ClientProvider:
     cdef client.Context ctxt
@@ -38,7 +38,15 @@ cdef extern from "<p4p.h>" namespace "p4p":
     # pvxs_value.cpp
     int except_map()
     object asPy(const data.Value& v, bool unpackstruct, bool unpackrecurse, object wrapper) except+
+    object asPyColumns(const data.Value& v) except+ except_map
+    object asPyChanged(const data.Value& v, object wrapper) except+ except_map
+    object asPyStack(object values, const string& name) except+ except_map
+    object asPyNDArray(const data.Value& v) except+ except_map
     void storePy(data.Value& v, object py, bool forceCast) except+ except_map
+    void storePyPlanned(data.Value& v, object py, object plans) except+ except_map
+    size_t fieldNoIndex
+    size_t fieldIndex(const data.Value& top, const string& name) except+ except_map
+    data.Value fieldAt(const data.Value& top, size_t index) except+
     object tostr(const data.Value& v, size_t limit, bool showval) except+
 
     # pvxs_sharedpv.cpp
@@ -111,6 +119,12 @@ cdef public:
         wrap.arr = arr
         return wrap
 
+    cdef bool pvxs_unwrap_array(object obj, sharedArray.shared_array[const void]* arr):
+        if isinstance(obj, SharedArray):
+            arr[0] = (<SharedArray>obj).arr
+            return True
+        return False
+
 cdef lookupMember(data.Value* dest, const data.Value& top, key, int err):
         cdef string ckey
         cdef data.Value mem
@@ -147,7 +161,9 @@ cdef class _Value:
             base = type
             self.val = base.proto.cloneEmpty()
             if value is not None:
-                storePy(self.val, value, True)
+                if base.plans is None:
+                    base.plans = {}
+                storePyPlanned(self.val, value, base.plans)
 
         elif clone is not None:
             val = clone
@@ -240,19 +256,37 @@ cdef class _Value:
 
         return asPy(mem, True, True, None)
 
-    def todict(self, name=None, wrapper=None):
-        """todict(name=None, wrapper=None) -> Mapping[str, Value]
+    def todict(self, name=None, wrapper=None, changed_only=False):
+        """todict(name=None, wrapper=None, changed_only=False) -> Mapping[str, Value]
 
         Return this Value (or the named sub-field) translated into a dict
 
         :param str name: Sub-field name, or None
         :param callable wrapper: Passed an iterable of name,value tuples.  By default ``dict``  eg. could be OrderedDict
+        :param bool changed_only: Include only marked fields (cf. `changedSet()`), and the sub-structures containing them.
+                                  eg. for a monitor update.
         """
         cdef data.Value mem
         lookupMember(&mem, self.val, name, 2)
 
+        if changed_only:
+            return asPyChanged(mem, wrapper or dict)
         return asPy(mem, True, True, wrapper or dict)
 
+    def tocolumns(self, name=None):
+        """tocolumns(name=None) -> Mapping[str, numpy.ndarray | List[str]]
+
+        Return this Value (or the named sub-field), which must be an array of structures with scalar members,
+        translated into a dict of columns.  Numeric members become numpy arrays, and string members lists.
+        The reverse of assigning a dict of columns, or a numpy structured array, to a structure array.
+
+        :param str name: Sub-field name, or None
+        """
+        cdef data.Value mem
+        lookupMember(&mem, self.val, name, 2)
+
+        return asPyColumns(mem)
+
     def getID(self):
         """getID() -> str
         Return Type id= string
@@ -369,8 +403,13 @@ cdef public api:
         raw.val = v
         return raw
 
+cdef object Value_wrap(const data.Value& v):
+    return pvxs_pack(v)
+
 cdef class _Type:
     cdef data.Value proto
+    # dict key tuple -> assignment plan, see storePyPlanned()
+    cdef dict plans
 
     def __init__(self, spec, basestring id=None, base=None):
         cdef data.TypeDef tdef
@@ -389,6 +428,11 @@ cdef class _Type:
         appendPrototype(tdef, spec)
         self.proto = tdef.create()
 
+    def _assignPlans(self):
+        """Copy of the cached dict assignment plans.  For testing.
+        """
+        return dict(self.plans or {})
+
     def getID(self):
         """getId() -> str
         Return Type id= string
@@ -451,6 +495,86 @@ cdef public:
     cdef bool pvxs_isType(object v):
         return isinstance(v, _Type)
 
+cdef class FieldRef:
+    """FieldRef(type, name)
+
+    A reference to the named sub-field of Values of a Type.
+    The name is resolved once to the position of the sub-field within the Type.
+    Accessing a Value of this Type then skips the lookup by name,
+    for use when accessing many Values in a loop.
+    Values of other types are accessed by name.
+
+    >>> sevr = FieldRef(NTScalar('d').type, 'alarm.severity')
+    >>> [sevr.get(V) for V in values]
+
+    :param Type type: The Type of Values to be accessed
+    :param str name: Sub-field name
+    """
+    cdef string cname
+    cdef data.Value proto
+    cdef size_t index
+    cdef readonly object name
+
+    def __init__(self, _Type type not None, basestring name):
+        self.cname = name.encode()
+        self.name = name
+        if not type.proto[self.cname].valid():
+            raise KeyError(name)
+        self.proto = type.proto
+        self.index = fieldIndex(self.proto, self.cname)
+
+    cdef data.Value _lookup(self, _Value value) except *:
+        cdef data.Value mem
+        if self.index!=fieldNoIndex and value.val.equalType(self.proto):
+            return fieldAt(value.val, self.index)
+
+        mem = value.val[self.cname]
+        if not mem.valid():
+            raise KeyError(self.name)
+        return mem
+
+    def get(self, _Value value not None):
+        """get(value : Value) -> Value | Any
+        Equivalent to ``value[name]``
+        """
+        return asPy(self._lookup(value), False, False, None)
+
+    def set(self, _Value value not None, object val):
+        """set(value : Value, val)
+        Equivalent to ``value[name] = val``
+        """
+        cdef data.Value mem = self._lookup(value)
+        storePy(mem, val, True)
+
+    def __repr__(self):
+        return 'FieldRef(%r)'%self.name
+
+def stackValues(values, basestring name='value'):
+    """stackValues(values : Sequence[Value], name='value') -> (numpy.ndarray, numpy.ndarray)
+
+    Copy the named numeric sub-field of many Values of the same type into one numpy array.
+    A 1-d array for a scalar field, or a 2-d array with one row for each Value for an array field.
+    Shorter arrays are zero padded.
+    Also returns a 1-d array of ``timeStamp`` in seconds, or NaN for Values without a ``timeStamp``.
+    An empty sequence gives two empty float64 arrays.
+
+    >>> updates = [] # eg. appended by a monitor callback
+    >>> data, T = stackValues(updates)
+
+    :param values: A sequence of Values
+    :param str name: Sub-field name
+    """
+    return asPyStack(values, name.encode())
+
+def unwrapNDArray(_Value value not None):
+    """unwrapNDArray(value : Value) -> (numpy.ndarray, dict)
+
+    Return the ``value`` field of an NTNDArray as a read-only numpy array,
+    shaped according to ``dimension[].size`` without copying the array data.
+    Also returns a dict of ``attribute[]`` name and value.
+    """
+    return asPyNDArray(value.val)
+
 # sub-class hooks
 Value = _Value
 Type = _Type
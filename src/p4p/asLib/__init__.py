@@ -45,11 +45,18 @@ class Engine(object):
     """
     def __init__(self, acf = None, ctxt = None):
         self._lock = Lock()
-        # {Channel:(group, user, host, level)}
+        # {Channel:(group, user, host, level, roles)}
         self._anodes = WeakKeyDictionary()
         self._ctxt = ctxt
         self._asg = {}
+        self._uag = {}
+        self._hag_addr = {}
+        # {'pvname':[('name','VAR')]}
+        self._invars = {}
         self._subscriptions = {}
+        # {(group, user, host, level, frozenset(roles)):(put, rpc, uncached, audit)}
+        # cleared whenever rules, groups, or inputs change.
+        self._perms = {}
 
         self.parse(acf or self.defaultACF)
 
@@ -69,6 +76,11 @@ class Engine(object):
         }
 
     def parse(self, acf):
+        '''(Re)load ACF text.
+
+        On reload, only channels whose permissions could be changed are re-evaluated.
+        eg. those in an ASG whose rules, or referenced UAG or HAG membership, were changed.
+        '''
         ast = parse(acf)
 
         # map user or host to set of groups
@@ -159,25 +171,91 @@ class Engine(object):
             for pv, grps in invars.items():
                 _log.warning('No Client to connect to ACF %s for %s', pv, grps)
 
-        # cancel any active subscriptions
-        [S.close() for S in self._subscriptions.values()]
+        # cancel subscriptions which are no longer needed, or are used differently
+        keep = {}
+        for pv, S in self._subscriptions.items():
+            if invars.get(pv)==self._invars.get(pv):
+                keep[pv] = S
+            else:
+                S.close()
 
         with self._lock:
+            changed = self._changed(asg, uag, hag_addr, invars)
+
+            # retain last values of unchanged inputs
+            for pv in keep:
+                for grp, var in invars[pv]:
+                    old = self._asg[grp][1]
+                    if var in old:
+                        asg[grp][1][var] = old[var]
+
             self._uag = uag
             self._hag = hag
             self._asg = asg
+            self._perms = {}
             self._asg_DEFAULT = asg.get('DEFAULT', [])
             self._hag_addr = hag_addr
+            self._invars = invars
 
-        self._recompute()
+        self._recompute(only=changed)
 
         # create new subscriptions
         # which will trigger a lot of recomputes
         if self._ctxt is not None:
-            [_log.debug('subscribing to %s for %s', pv, grps) for pv,grps in invars.items()]
-            self._subscriptions = {pv: self._ctxt.monitor(pv, partial(self._var_update, grps), notify_disconnect=True) for pv,grps in invars.items()}
-        else:
-            self._subscriptions = {}
+            for pv, grps in invars.items():
+                if pv not in keep:
+                    _log.debug('subscribing to %s for %s', pv, grps)
+                    keep[pv] = self._ctxt.monitor(pv, partial(self._var_update, grps), notify_disconnect=True)
+        self._subscriptions = keep
+
+    @staticmethod
+    def _invert(groups):
+        # {member:{group}} -> {group:{member}}
+        ret = defaultdict(set)
+        for member, grps in groups.items():
+            for grp in grps:
+                ret[grp].add(member)
+        return ret
+
+    @staticmethod
+    def _canon(group):
+        # comparable form of ASG rules.  CALC by expression text.
+        if group is None:
+            return None
+        rules, _inputs = group
+        return [(mask, asl, trap, [cond[:2] for cond in conds]) for mask, asl, trap, conds in rules]
+
+    def _changed(self, asg, uag, hag_addr, invars):
+        '''Set of ASG names whose members could have different permissions
+        with the new rules.
+        '''
+        changed = set()
+        for name in set(asg)|set(self._asg):
+            if self._canon(asg.get(name))!=self._canon(self._asg.get(name)):
+                changed.add(name)
+
+        for name, inps in invars.items():
+            if inps!=self._invars.get(name):
+                changed |= set(grp for grp, _var in inps)
+        for name, inps in self._invars.items():
+            if inps!=invars.get(name):
+                changed |= set(grp for grp, _var in inps)
+
+        def members(old, new):
+            old, new = self._invert(old), self._invert(new)
+            return set(grp for grp in set(old)|set(new) if old.get(grp)!=new.get(grp))
+
+        uags = members(self._uag, uag)
+        hags = members(self._hag_addr, hag_addr)
+
+        if uags or hags:
+            for name, (rules, _inputs) in asg.items():
+                for _mask, _asl, _trap, conds in rules:
+                    for cond in conds:
+                        if (cond[0]=='UAG' and cond[1]&uags) or (cond[0]=='HAG' and cond[1]&hags):
+                            changed.add(name)
+
+        return changed
 
     def _var_update(self, grps, value):
         # clear old value first
@@ -194,19 +272,23 @@ class Engine(object):
             for asg, var in grps:
                 _rules, inputs = self._asg[asg]
                 inputs[var] = val or 0.0
+            self._perms = {}
 
         if grps:
             self._recompute(only={asg for asg,var in grps})
 
     def _recompute(self, only=None):
-        _log.debug("Recompute %s", only or "all")
+        _log.debug("Recompute %s", "all" if only is None else only)
+        if only is not None and not only:
+            return
         anodes, self._anodes = self._anodes, WeakKeyDictionary()
 
-        for channel, (group, user, host, level) in anodes.items():
-            if only is None or group in only:
-                self.create(channel, group, user, host, level)
+        for channel, (group, user, host, level, roles) in anodes.items():
+            # unknown ASG uses DEFAULT
+            if only is None or group in only or (group not in self._asg and 'DEFAULT' in only):
+                self.create(channel, group, user, host, level, roles)
             else:
-                self._anodes[channel] = (group, user, host, level)
+                self._anodes[channel] = (group, user, host, level, roles)
 
     @staticmethod
     def _gethostbyname(host):
@@ -230,63 +312,82 @@ class Engine(object):
         _hag_addr = self._resolve_hag(self._hag)
         with self._lock:
             self._hag_addr = _hag_addr
+            self._perms = {}
 
         self._recompute()
 
+    # limit on number of memoized permission sets
+    maxPerms = 4096
+
     def create(self, channel, group, user, host, level, roles=[]):
-        # Default to restrictive.  Used in case of error
-        perm = 0
         _log.debug('(re)create %s, %s, %s, %s, %s', channel.name, group, user, host, level)
 
+        key = (group, user, host, level, frozenset(roles))
+
         with self._lock:
+            perm = self._perms.get(key)
+            if perm is None:
+                perm, ok = self._evaluate(channel, group, user, host, level, roles)
+                if ok: # errors are logged each time
+                    if len(self._perms)>=self.maxPerms:
+                        self._perms.clear()
+                    self._perms[key] = perm
+
+            put, rpc, uncached, audit = perm
+            channel.access(put=put, rpc=rpc, uncached=uncached, audit=audit)
+
+            self._anodes[channel] = (group, user, host, level, tuple(roles))
+
+    def _evaluate(self, channel, group, user, host, level, roles):
+        # call with lock held.
+        # returns ((put, rpc, uncached, audit), ok)
+        # Default to restrictive.  Used in case of error
+        perm = 0
+        ok = True
 
-            uags = self._uag.get(user, set())
-            for role in roles:
-                uags |= self._uag.get('role/'+role, set())
-            hags = self._hag_addr.get(host, set())
-            rules, inputs = self._asg.get(group, self._asg_DEFAULT)
+        uags = set(self._uag.get(user, ()))
+        for role in roles:
+            uags |= self._uag.get('role/'+role, set())
+        hags = self._hag_addr.get(host, set())
+        rules, inputs = self._asg.get(group, self._asg_DEFAULT)
 
-            trapit = False
-            try:
-                for mask, asl, trap, conds in rules:
-                    accept = True
-                    for cond in conds:
-                        if cond[0]=='UAG':
-                            accept = len(cond[1].intersection(uags))
-                        elif cond[0]=='HAG':
-                            accept = len(cond[1].intersection(hags))
-                        elif cond[0]=='CALC':
-                            try:
-                                accept = float(eval(cond[2], {}, inputs) or 0.0) >= 0.5 # horray for legacy... I mean compatibility
-                            except:
-                                # this could be any of a number of exceptions
-                                # which all add up to the same.  Invalid expression
-                                accept = False
-                                _log.exception('Error evaluating: %s with %s', cond[1], [(k,v,type(v)) for k,v in inputs.items()])
-                            else:
-                                _log.debug('Evaluate %s with %s -> %s', cond, [(k,v,type(v)) for k,v in inputs.items()], accept)
-                        else:
-                            warnings.warn("Invalid AST RULE: %s"%cond)
+        trapit = False
+        try:
+            for mask, asl, trap, conds in rules:
+                accept = True
+                for cond in conds:
+                    if cond[0]=='UAG':
+                        accept = len(cond[1].intersection(uags))
+                    elif cond[0]=='HAG':
+                        accept = len(cond[1].intersection(hags))
+                    elif cond[0]=='CALC':
+                        try:
+                            accept = float(eval(cond[2], {}, inputs) or 0.0) >= 0.5 # horray for legacy... I mean compatibility
+                        except:
+                            # this could be any of a number of exceptions
+                            # which all add up to the same.  Invalid expression
                             accept = False
+                            ok = False
+                            _log.exception('Error evaluating: %s with %s', cond[1], [(k,v,type(v)) for k,v in inputs.items()])
+                        else:
+                            _log.debug('Evaluate %s with %s -> %s', cond, [(k,v,type(v)) for k,v in inputs.items()], accept)
+                    else:
+                        warnings.warn("Invalid AST RULE: %s"%cond)
+                        accept = False
 
-                        if not accept:
-                            break
-
-                    if accept:
-                        trapit |= trap
-                        perm |= mask
-
-            except:
-                _log.exception("Error while calculating ASG for %s, %s, %s, %s, %s",
-                            channel, group, user, host, level)
+                    if not accept:
+                        break
 
-            put = perm & PUT
-            rpc = perm & RPC
-            uncached = perm & UNCACHED
+                if accept:
+                    trapit |= trap
+                    perm |= mask
 
-            channel.access(put=bool(put), rpc=bool(rpc), uncached=bool(uncached), audit=trapit)
+        except:
+            ok = False
+            _log.exception("Error while calculating ASG for %s, %s, %s, %s, %s",
+                        channel, group, user, host, level)
 
-            self._anodes[channel] = (group, user, host, level)
+        return (bool(perm & PUT), bool(perm & RPC), bool(perm & UNCACHED), bool(trapit)), ok
 
     def _check_host(self, hag, user, host):
         groups = self._hag_addr.get(host) or set()
@@ -112,6 +112,12 @@ class PVList(object):
             except Exception as e:
                 raise e.__class__("Error on line %s: %s"%(lineno, e))
 
+        # for affected()
+        self._allow = allow
+        self._deny = set((pattern, None) for pattern in deny_all)
+        for addr, exprs in deny_from.items():
+            self._deny |= set((pattern, addr) for pattern in exprs)
+
         deny_all = list(deny_all)
 
         # RE's for each host specific list also include the general list.
@@ -125,6 +131,27 @@ class PVList(object):
 
         assert self._allow_pat.groups+1==ngroups, (self._allow_pat.groups, ngroups)
 
+    def affected(self, old):
+        '''Compare with a previous PVList.
+
+        Returns a function of a PV name (str) which returns False only if
+        compute() will give the same result as old.compute() for every client.
+        '''
+        common = [pattern for pattern in self._allow if pattern in old._allow]
+        if common!=[pattern for pattern in old._allow if pattern in self._allow]:
+            # precedence changed
+            return lambda pv: True
+
+        changed = set(pattern for pattern in set(self._allow)|set(old._allow)
+                      if self._allow.get(pattern)!=old._allow.get(pattern))
+        changed |= set(pattern for pattern, _addr in self._deny^old._deny)
+
+        if not changed:
+            return lambda pv: False
+
+        R = _re_join(list(changed), '?:')
+        return lambda pv: R.match(pv) is not None
+
     @staticmethod
     def _gethostbyname(host):
         return socket.gethostbyname(host)
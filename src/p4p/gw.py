@@ -10,6 +10,7 @@ import pprint
 import json
 import re
 import sqlite3
+import fnmatch
 from contextlib import closing
 
 from functools import wraps, reduce
@@ -129,6 +130,8 @@ statsType = Type([
     ('ccacheSize', NTScalar.buildType('L')),
     ('mcacheSize', NTScalar.buildType('L')),
     ('gcacheSize', NTScalar.buildType('L')),
+    ('mcacheBytes', NTScalar.buildType('L')),
+    ('gcacheBytes', NTScalar.buildType('L')),
     ('banHostSize', NTScalar.buildType('L')),
     ('banPVSize', NTScalar.buildType('L')),
     ('banHostPVSize', NTScalar.buildType('L')),
@@ -299,6 +302,41 @@ class GWStats(object):
         self.tbl_dsbyhosttx = addpv(dir='TX', suffix='ds:byhost:tx')
         self.tbl_dsbyhostrx = addpv(dir='RX', suffix='ds:byhost:rx')
 
+        # downstream subscribers which are not keeping up
+        self._pvs['ds:slow'] = self.tbl_dsslow = SharedPV(nt=TableBuilder([
+            ('s', 'name', 'PV'),
+            ('s', 'peer', 'Client'),
+            ('L', 'queue', 'Queued'),
+            ('L', 'limit', 'Queue Size'),
+            ('L', 'squash', 'Squashed'),
+        ]), initial=[])
+
+        # load on upstream client contexts.  cf. clients[].shards
+        self._pvs['us:shards'] = self.tbl_usshards = SharedPV(nt=TableBuilder([
+            ('s', 'client', 'Client'),
+            ('L', 'shard', 'Shard'),
+            ('L', 'channels', 'Channels'),
+            ('L', 'connected', 'Connected'),
+            ('L', 'subscriptions', 'Subscriptions'),
+            ('d', 'rate', 'Updates/s'),
+        ]), initial=[])
+        self._shardwork = {}
+
+        # where our threads run.  cf. 'affinity'
+        self._pvs['threads:placement'] = self.tbl_threads = SharedPV(nt=TableBuilder([
+            ('s', 'name', 'Thread'),
+            ('L', 'tid', 'TID'),
+            ('s', 'allowed', 'Allowed CPUs'),
+            ('i', 'cpu', 'Last CPU'),
+            ('i', 'node', 'NUMA Node'),
+        ]), initial=[])
+
+        # client hosts whose searches exceed searchrate
+        self._pvs['ds:searchdrop'] = self.tbl_dssearchdrop = SharedPV(nt=TableBuilder([
+            ('s', 'host', 'Client'),
+            ('L', 'drop', 'Dropped'),
+        ]), initial=[])
+
     def bindto(self, provider, prefix):
         'Add myself to a StaticProvider'
 
@@ -352,7 +390,33 @@ class GWStats(object):
 
             self.clientsPV.post([row[0] for row in C.execute('SELECT DISTINCT peer FROM us')])
 
+        slow = []
+        for handler in self.handlers:
+            slow.extend(handler.provider.slowConsumers())
+        slow.sort(key=lambda ent:(ent[5], ent[3]), reverse=True)
+        self.tbl_dsslow.post([(dsname, peer, nQ, limQ, nSq) for _usname, dsname, peer, nQ, limQ, nSq in slow[:10]])
+
+        shards, work = [], {}
+        for handler in self.handlers:
+            for idx, (nchan, nconn, nsub, nwork) in enumerate(handler.provider.shardStats()):
+                key = (handler.name, idx)
+                work[key] = nwork
+                rate = (nwork - self._shardwork.get(key, nwork))/norm
+                shards.append((handler.name, idx, nchan, nconn, nsub, rate))
+        self._shardwork = work
+        self.tbl_usshards.post(shards)
+
+        self.tbl_threads.post(sorted(threadPlacement()))
+
+        drops = {}
+        for handler in self.handlers:
+            for host, nDrop in handler.provider.searchDrops():
+                drops[host] = drops.get(host, 0) + nDrop
+        drops = sorted(drops.items(), key=lambda ent:ent[1], reverse=True)
+        self.tbl_dssearchdrop.post(drops[:10])
+
         statsSum = {'ccacheSize.value':0, 'mcacheSize.value':0, 'gcacheSize.value':0,
+                    'mcacheBytes.value':0, 'gcacheBytes.value':0,
                     'banHostSize.value':0, 'banPVSize.value':0, 'banHostPVSize.value':0}
         stats = [handler.provider.stats() for handler in self.handlers]
         for key in statsSum:
@@ -376,7 +440,10 @@ class GWHandler(object):
         self.channels = {}
 
         self.provider = None
+        self.name = None
         self.getholdoff = None
+        self.deadband = None
+        self.reldeadband = None
 
 
     def testChannel(self, pvname, peer):
@@ -411,6 +478,8 @@ class GWHandler(object):
                 self.acf.create(chan, asg, op.account, peer, asl, op.roles)
             if self.getholdoff is not None:
                 chan.access(holdoff=self.getholdoff)
+            if self.deadband is not None or self.reldeadband is not None:
+                chan.access(deadband=self.deadband, reldeadband=self.reldeadband)
         except:
             # create() should fail secure.  So allow this client to
             # connect R/O.  We already acknowledged the search, so
@@ -418,6 +487,39 @@ class GWHandler(object):
             _log.exception("Default restrictive for %s from %s", op.name, op.peer)
         return chan
 
+    def reload(self, pvlist):
+        '''Replace pvlist without disconnecting clients needlessly.
+
+        Only existing channels whose names match changed pvlist entries are re-evaluated.
+        Those which are now denied, or which map to a different upstream name, are closed.
+        Permissions of others are updated in place.
+        '''
+        affected = pvlist.affected(self.pvlist)
+        self.pvlist = pvlist
+
+        with self.channels_lock:
+            chans = [chan for chans in self.channels.values() for chan in chans]
+
+        nclose = nupdate = 0
+        for chan in chans:
+            dsname = chan.dsname
+            if chan.expired or not affected(dsname.decode('UTF-8')):
+                continue
+
+            peer = chan.peer.split(':',1)[0]
+            usname, asg, asl = pvlist.compute(dsname, peer)
+            if not usname or usname.encode('UTF-8')!=chan.name:
+                chan.close()
+                nclose += 1
+            elif not self.readOnly:
+                self.acf.create(chan, asg, chan.account, peer, asl, chan.roles)
+                nupdate += 1
+
+        # forget previously denied names, which may now be allowed
+        self.provider.clearBan()
+
+        _log.info('Reload pvlist.  %d of %d channels updated, %d closed', nupdate, len(chans), nclose)
+
     def audit(self, msgs):
         for msg in msgs:
             _log_audit.info('%s', msg)
@@ -466,11 +568,12 @@ class GWHandler(object):
     def asDebug(self, op):
         return asDebugType(self.acf.report())
 
-def readnproc(args, fname, fn, **kws):
+def readnproc(args, fname, fn, record=True, **kws):
     try:
         if fname:
             fullname = os.path.join(os.path.dirname(args.config), fname)
-            args._all_config_files.append(fullname)
+            if record: # on reload, already listed
+                args._all_config_files.append(fullname)
             with open(fullname, 'r') as F:
                 data = F.read()
         else:
@@ -486,6 +589,130 @@ def readnproc(args, fname, fn, **kws):
         _log.error('In "%s" %s', fname, e)
         sys.exit(1)
 
+def saveCache(provider, fname):
+    '''Save names in channel cache, for use by warmCache() after restart
+    '''
+    tmp = fname+'.tmp'
+    with open(tmp, 'w') as F:
+        json.dump({'version':1, 'names':provider.cacheSnapshot()}, F)
+    try:
+        os.replace(tmp, fname)
+    except AttributeError: # py 2.7
+        os.rename(tmp, fname)
+
+def warmCache(provider, fname, count, timeout):
+    '''Connect the most recently used names saved by saveCache()
+    '''
+    try:
+        with open(fname, 'r') as F:
+            names = json.load(F)['names']
+    except IOError as e:
+        _log.info('No channel cache to warm from "%s" : %s', fname, e)
+        return
+    except (ValueError, KeyError) as e:
+        _log.warning('Ignore invalid channel cache file "%s" : %s', fname, e)
+        return
+
+    names.sort(key=lambda ent:ent[1], reverse=True)
+    names = [usname for usname, _lastuse in names[:count]]
+    T0 = time.time()
+    N = provider.warm(names, timeout)
+    _log.info('Warm %d of %d channels connected from "%s" in %.1f sec', N, len(names), fname, time.time()-T0)
+
+def parseCPUs(spec):
+    '''Parse a Linux style CPU list.  eg. "0-3,8" -> set([0, 1, 2, 3, 8])
+    '''
+    cpus = set()
+    for part in spec.split(','):
+        part = part.strip()
+        if not part:
+            continue
+        lo, _sep, hi = part.partition('-')
+        lo = int(lo)
+        hi = int(hi) if hi else lo
+        if lo<0 or hi<lo:
+            raise ValueError('Invalid CPU range "%s"'%part)
+        cpus.update(range(lo, hi+1))
+    if not cpus:
+        raise ValueError('Empty CPU list "%s"'%spec)
+    return cpus
+
+def _readproc(fname):
+    try:
+        with open(fname, 'r') as F:
+            return F.read()
+    except (IOError, OSError):
+        return None
+
+def threadPlacement():
+    '''Thread name, ID, allowed CPU list, last CPU, and NUMA node for each thread of this process.
+    From /proc and /sys (ie. only Linux).
+    '''
+    nodes = {} # {cpu:node}
+    try:
+        for ent in os.listdir('/sys/devices/system/node'):
+            if ent.startswith('node') and ent[4:].isdigit():
+                cpulist = _readproc('/sys/devices/system/node/%s/cpulist'%ent)
+                if cpulist and cpulist.strip():
+                    for cpu in parseCPUs(cpulist):
+                        nodes[cpu] = int(ent[4:])
+    except (OSError, ValueError):
+        pass
+
+    ret = []
+    try:
+        tids = os.listdir('/proc/self/task')
+    except OSError:
+        return ret
+    for tid in tids:
+        comm = _readproc('/proc/self/task/%s/comm'%tid)
+        stat = _readproc('/proc/self/task/%s/stat'%tid)
+        status = _readproc('/proc/self/task/%s/status'%tid)
+        if comm is None or stat is None or status is None:
+            continue # exited
+        # skip past "pid (comm)" as comm may contain spaces
+        cpu = int(stat[stat.rfind(')')+2:].split()[36]) # processor
+        allowed = ''
+        for line in status.splitlines():
+            if line.startswith('Cpus_allowed_list:'):
+                allowed = line.split(':', 1)[1].strip()
+        ret.append((comm.strip(), int(tid), allowed, cpu, nodes.get(cpu, -1)))
+    return ret
+
+class ThreadAffinity(object):
+    '''Pin threads of this process to CPU sets by thread name.
+
+    Rules are a list of (pattern, cpus) tuples.  The first pattern matching a thread name is used.
+    Only Linux is supported.
+    '''
+    def __init__(self, rules):
+        self.rules = [(pattern, parseCPUs(cpus)) for pattern, cpus in rules]
+        self._applied = {} # {tid:set(cpu)}
+
+    def apply(self):
+        '''Apply to all current threads.  Called periodically to catch threads started later.
+        '''
+        if not self.rules:
+            return
+        elif not hasattr(os, 'sched_setaffinity'):
+            _log.warning('Thread affinity not supported on this platform/python')
+            self.rules = []
+            return
+
+        current = {}
+        for name, tid, _allowed, _cpu, _node in threadPlacement():
+            for pattern, cpus in self.rules:
+                if fnmatch.fnmatchcase(name, pattern):
+                    if self._applied.get(tid)!=cpus:
+                        try:
+                            os.sched_setaffinity(tid, cpus)
+                            _log.debug('Pin thread %s (%d) to CPUs %s', name, tid, sorted(cpus))
+                        except OSError as e:
+                            _log.warning('Unable to pin thread %s (%d) : %s', name, tid, e)
+                    current[tid] = cpus
+                    break
+        self._applied = current
+
 def comment_sub(M):
     '''Replace C style comment with equivalent whitespace, includeing newlines,
        to preserve line and columns numbers in parser errors (py3 anyway)
@@ -538,7 +765,14 @@ class App(object):
         if not args.test_config:
             self.stats = GWStats(jconf.get('statsdb'))
 
+        try:
+            self.affinity = ThreadAffinity([(jaff['threads'], jaff['cpus']) for jaff in jconf.get('affinity', [])])
+        except (KeyError, TypeError, ValueError) as e:
+            _log.error('Invalid affinity: %r', e)
+            sys.exit(1)
+
         clients = {}
+        shards = {} # {'client':int}
         statusprefix = None
 
         names = [jcli['name'] for jcli in jconf['clients']]
@@ -564,6 +798,11 @@ class App(object):
             for confKeys, confVals in client_conf.items():
                 _log.info( "    %s : %s", confKeys, confVals)
 
+            shards[name] = int(jcli.get('shards', 1))
+            if shards[name]<1:
+                _log.error('Client %s shards must be >= 1', name)
+                sys.exit(1)
+
             if args.test_config:
                 clients[name] = None
             else:
@@ -612,6 +851,14 @@ class App(object):
         # but aren't otherwise accessed after startup.
         self.__lifesupport = []
 
+        # [(provider, filename)] for saveCache()
+        self._cachefiles = []
+
+        # [(access, pvlist, Engine, [GWHandler], StaticProvider)] for reload()
+        self._reloadable = []
+        self._reload_lock = threading.Lock()
+        self._args = args
+
         gwclients = []
 
         for jsrv in jconf['servers']:
@@ -655,22 +902,39 @@ class App(object):
             providers = [statusp]
             self.__lifesupport += [statusp]
 
+            handlers = []
             try:
                 for client in jsrv['clients']:
                     pname = u'gws.%s.%s'%(name, client)
+                    cname = client
 
                     client = clients[client]
 
                     handler = GWHandler(access, pvlist, readOnly=jconf.get('readOnly', False))
+                    handler.name = pname
                     handler.getholdoff = jsrv.get('getholdoff')
+                    handler.deadband = jsrv.get('deadband')
+                    handler.reldeadband = jsrv.get('reldeadband')
 
                     if not args.test_config:
-                        handler.provider = _gw.Provider(pname, client, handler) # implied installProvider()
+                        handler.provider = _gw.Provider(pname, client, handler, shards=shards[cname]) # implied installProvider()
+                        handler.provider.slowPolicy(jsrv.get('slowpolicy', u'squash'), jsrv.get('slowlimit', 100))
+                        handler.provider.cacheBudget(int(jsrv.get('cachebudget', 0)*1024*1024))
+                        handler.provider.searchLimit(jsrv.get('searchrate', 0), jsrv.get('searchburst', 0))
+                        if jsrv.get('record'):
+                            handler.provider.record(jsrv['record'].format(server=name, client=cname))
+                        if jsrv.get('cachefile'):
+                            # before server startup, so that clients reconnecting find a warm cache
+                            fname = os.path.join(os.path.dirname(args.config),
+                                                 jsrv['cachefile'].format(server=name, client=cname))
+                            warmCache(handler.provider, fname, jsrv.get('warmcount', 1000), jsrv.get('warmtimeout', 5.0))
+                            self._cachefiles.append((handler.provider, fname))
                         providers.append((handler.provider, 10))
 
                     self.__lifesupport += [client]
                     gwclients +=[handler.provider]
                     self.stats.handlers.append(handler)
+                    handlers.append(handler)
 
                 if 'statusprefix' in jsrv:
                     self.stats.bindto(statusp, jsrv['statusprefix'])
@@ -687,6 +951,8 @@ class App(object):
                     for spv in statusp.keys():
                         handler.provider.forceBan(usname=spv.encode('utf-8'))
 
+                self._reloadable.append((jsrv.get('access', ''), jsrv.get('pvlist', ''), access, handlers, statusp))
+
                 try:
                     server = Server(providers=providers,
                                     conf=server_conf, useenv=False)
@@ -724,6 +990,9 @@ class App(object):
         if args.no_ban_local:
             _log.info('--no-ban-local is no longer needed, and is a no-op')
 
+        # all server and client worker threads now running
+        self.affinity.apply()
+
 
     def run(self):
         # needs to be longer than twice the longest search interval
@@ -734,7 +1003,9 @@ class App(object):
                 _log.debug("Channel Cache sweep")
                 try:
                     self.stats.sweep()
+                    self.affinity.apply()
                     self.stats.update_stats(period)
+                    self.saveCaches()
                 except:
                     _log.exception("Error during periodic sweep")
 
@@ -743,8 +1014,39 @@ class App(object):
             pass
         finally:
             _log.info( '*** Gateway STOPS now.')
+            try:
+                self.saveCaches()
+            except:
+                _log.exception("Error saving channel cache")
             [server.stop() for server in self.servers.values()]
 
+    def reload(self):
+        '''Re-read ACF and pvlist files, and apply changes to existing channels in place.
+        Invalid files are logged and ignored, leaving the previous configuration in effect.
+        '''
+        args = self._args
+        with self._reload_lock:
+            _log.info('Reloading ACF and pvlist files')
+            for accessfile, pvlistfile, access, handlers, statusp in self._reloadable:
+                try:
+                    T0 = time.time()
+                    pvlist = readnproc(args, pvlistfile, PVList, record=False)
+                    # parse in place, so that existing channels are updated
+                    readnproc(args, accessfile, lambda data: access.parse(data or Engine.defaultACF), record=False)
+
+                    for handler in handlers:
+                        handler.reload(pvlist)
+                        for spv in statusp.keys():
+                            handler.provider.forceBan(usname=spv.encode('utf-8'))
+
+                    _log.info('Reloaded "%s" and "%s" in %.3f sec', accessfile, pvlistfile, time.time()-T0)
+                except (SystemExit, Exception):
+                    _log.exception('Reload of "%s" and "%s" failed.  Previous configuration remains.', accessfile, pvlistfile)
+
+    def saveCaches(self):
+        for provider, fname in self._cachefiles:
+            saveCache(provider, fname)
+
     @staticmethod
     def sleep(dly):
         time.sleep(dly)
@@ -813,6 +1115,12 @@ def main(args=None):
         for fname in args._all_config_files:
             print(fname)
     else:
+        try:
+            import signal
+            # from another thread, as signal may interrupt main thread while locks are held
+            signal.signal(signal.SIGHUP, lambda sig, frame: threading.Thread(target=app.reload, name='GW Reload').start())
+        except (ImportError, AttributeError): # no SIGHUP on windows
+            pass
         app.run()
 
     return 0
@@ -0,0 +1,398 @@
+"""Gateway throughput/latency benchmark
+
+Stands up an upstream server serving synthetic load, a Gateway, and downstream clients,
+all in this process and on loopback.  Each scenario is timed, and results are
+written as JSON for comparison between releases. ::
+
+    python -m p4p.gwbench -O results.json
+    python -m p4p.gwbench --conf loopback.conf --subscribers 1,10,100
+
+By default, randomly chosen ports are used.  With --conf, the Gateway is configured
+from the given file (eg. loopback.conf in the source tree), and the upstream
+server binds to 127.0.0.1 with the ports of its first GW client.
+"""
+
+from __future__ import print_function
+
+import sys
+import os
+import json
+import time
+import logging
+import platform
+import threading
+
+try: # 2.7
+    from Queue import Queue, Empty
+except ImportError: # 3.x
+    from queue import Queue, Empty
+
+from .server import Server, StaticProvider
+from .client.thread import Context
+from .gw import App, getargs, jload
+from .version import version
+from . import _gw
+
+_log = logging.getLogger(__name__)
+
+try:
+    _clock = time.monotonic
+except AttributeError: # 2.7
+    _clock = time.time
+
+def percentile(S, p):
+    """p-th percentile of sorted sequence S, or None if empty
+    """
+    if not S:
+        return None
+    return S[min(len(S)-1, int(len(S)*p/100.0))]
+
+def summarize(lat, T):
+    """Summarize list of latencies (seconds) from operations completing in T seconds
+    """
+    lat = sorted(lat)
+    ret = {
+        'count':len(lat),
+        'seconds':T,
+        'rate':len(lat)/T if T>0 else None,
+    }
+    for name, p in (('p50', 50), ('p99', 99)):
+        V = percentile(lat, p)
+        ret[name] = V if V is None else V*1e3 # msec
+    ret['max'] = lat[-1]*1e3 if lat else None
+    return ret
+
+class ProcStats(object):
+    """Per-thread CPU time and RSS of this process.  From /proc (ie. only Linux)
+    """
+    def __init__(self):
+        try:
+            self.tick = float(os.sysconf('SC_CLK_TCK'))
+        except (AttributeError, ValueError, OSError):
+            self.tick = 100.0
+        self.prev = self.threads()
+
+    @staticmethod
+    def _read(fname):
+        try:
+            with open(fname, 'r') as F:
+                return F.read()
+        except (IOError, OSError):
+            return None
+
+    def threads(self):
+        """Cumulative CPU time by thread name
+        """
+        ret = {}
+        try:
+            tids = os.listdir('/proc/self/task')
+        except OSError:
+            return ret
+        for tid in tids:
+            comm = self._read('/proc/self/task/%s/comm'%tid)
+            stat = self._read('/proc/self/task/%s/stat'%tid)
+            if comm is None or stat is None:
+                continue
+            # skip past "pid (comm)" as comm may contain spaces
+            parts = stat[stat.rfind(')')+2:].split()
+            cpu = (int(parts[11]) + int(parts[12]))/self.tick # utime + stime
+            comm = comm.strip()
+            ret[comm] = ret.get(comm, 0.0) + cpu
+        return ret
+
+    def cpu(self):
+        """CPU seconds by thread name since previous call.
+        Threads which exited in the interim are not counted.
+        """
+        cur = self.threads()
+        ret = {}
+        for name, cpu in cur.items():
+            delta = cpu - self.prev.get(name, 0.0)
+            if delta>0:
+                ret[name] = delta
+        self.prev = cur
+        return ret
+
+    def rss(self):
+        """Resident size in bytes, or None if unknown
+        """
+        status = self._read('/proc/self/status') or ''
+        for line in status.splitlines():
+            if line.startswith('VmRSS:'):
+                return int(line.split()[1])*1024
+        return None
+
+def drive(op, items, nthreads):
+    """Call op(item) for each item, from nthreads concurrent threads.
+    Returns (latencies, errors, duration)
+    """
+    Q = Queue()
+    for item in items:
+        Q.put(item)
+
+    lat, errors = [], []
+    lock = threading.Lock()
+
+    def worker():
+        mylat, myerr = [], []
+        while True:
+            try:
+                item = Q.get_nowait()
+            except Empty:
+                break
+            T0 = _clock()
+            try:
+                op(item)
+            except Exception as e:
+                myerr.append(str(e))
+            else:
+                mylat.append(_clock()-T0)
+        with lock:
+            lat.extend(mylat)
+            errors.extend(myerr)
+
+    workers = [threading.Thread(target=worker, name='bench%d'%i) for i in range(max(1, nthreads))]
+    T0 = _clock()
+    [W.start() for W in workers]
+    [W.join() for W in workers]
+    return lat, errors, _clock()-T0
+
+class BenchApp(App):
+    def __init__(self, args):
+        super(BenchApp, self).__init__(args)
+        self.__evt = threading.Event()
+
+    def abort(self):
+        self.__evt.set()
+
+    def sleep(self, dly):
+        if self.__evt.wait(dly):
+            raise KeyboardInterrupt
+
+class Bench(object):
+    def __init__(self, args):
+        self.args = args
+        self.proc = ProcStats()
+        self.results = {}
+
+        if args.conf:
+            with open(args.conf, 'r') as F:
+                jconf = jload(F.read())
+            jcli = jconf['clients'][0]
+            self.conffile = args.conf
+            usconf = {
+                'EPICS_PVAS_INTF_ADDR_LIST':'127.0.0.1',
+                'EPICS_PVAS_SERVER_PORT':str(jcli['serverport']),
+                'EPICS_PVAS_BROADCAST_PORT':str(jcli['bcastport']),
+            }
+            self.upstream = Server(providers=[StaticProvider('gwbench')], conf=usconf, useenv=False)
+        else:
+            self.upstream = Server(providers=[StaticProvider('gwbench')], isolate=True)
+            jconf = {
+                'version':2,
+                'clients':[{
+                    'name':'client',
+                    'provider':'pva',
+                    'addrlist':'127.0.0.1',
+                    'autoaddrlist':False,
+                    'bcastport':self.upstream.conf()['EPICS_PVA_BROADCAST_PORT'],
+                    'serverport':0,
+                }],
+                'servers':[{
+                    'name':'server',
+                    'clients':['client'],
+                    'interface':['127.0.0.1'],
+                    'addrlist':'127.0.0.1',
+                    'autoaddrlist':False,
+                    'bcastport':0,
+                    'serverport':0,
+                }],
+            }
+            self.conffile = None
+
+        self.load(self.upstream._S)
+
+        self.dsconf = self.startGW(jconf)
+
+    def load(self, S):
+        """Add upstream PVs to _p4p.Server S
+        """
+        args = self.args
+        _gw.addLoadSource(S, 'bench:search:%u', count=args.search)
+        _gw.addLoadSource(S, 'bench:get:%u', count=args.channels)
+        _gw.addLoadSource(S, 'bench:mon', rate=args.rate)
+        _gw.addLoadSource(S, 'bench:wf', type='waveform', size=args.size, rate=args.rate)
+        _gw.addLoadSource(S, 'bench:put:%u', count=args.channels, echo=True)
+
+    def startGW(self, jconf):
+        import tempfile
+        if self.conffile is None:
+            F = tempfile.NamedTemporaryFile(mode='w', suffix='.conf', delete=False)
+            with F:
+                json.dump(jconf, F)
+            self._tempconf = conffile = F.name
+        else:
+            self._tempconf = None
+            conffile = self.conffile
+
+        self.gw = BenchApp(getargs().parse_args([conffile]))
+        self.gwthread = threading.Thread(target=self.gw.run, name='GW Main')
+        self.gwthread.start()
+
+        # first server with GW clients
+        for jsrv in jconf['servers']:
+            if jsrv['clients']:
+                return self.gw.servers[jsrv['name']+'_0'].conf()
+        raise ValueError('No GW server with clients')
+
+    def close(self):
+        self.gw.abort()
+        self.gwthread.join()
+        self.upstream.stop()
+        if self._tempconf:
+            os.remove(self._tempconf)
+
+    def context(self):
+        return Context('pva', conf=self.dsconf, useenv=False)
+
+    def record(self, name, lat, errors, T, **extra):
+        R = summarize(lat, T)
+        R['errors'] = len(errors)
+        R['cpu'] = self.proc.cpu()
+        R['rss'] = self.proc.rss()
+        R.update(extra)
+        self.results[name] = R
+        _log.info('%s: %d ops %.1f/s p50 %s ms p99 %s ms %d errors', name, R['count'], R['rate'] or 0.0,
+                  R['p50'], R['p99'], R['errors'])
+        if errors:
+            _log.debug('%s first error: %s', name, errors[0])
+
+    def search(self):
+        """Each GET through a fresh client context requires a search and connection
+        """
+        names = ['bench:search:%d'%i for i in range(self.args.search)]
+        self.proc.cpu()
+        with self.context() as ctxt:
+            lat, err, T = drive(lambda name: ctxt.get(name, timeout=self.args.timeout),
+                                names, self.args.threads)
+        self.record('search', lat, err, T, names=len(names))
+
+    def get(self):
+        names = ['bench:get:%d'%i for i in range(self.args.channels)]
+        with self.context() as ctxt:
+            ctxt.get(names, timeout=self.args.timeout) # connect
+            self.proc.cpu()
+            lat, err, T = drive(lambda name: ctxt.get(name, timeout=self.args.timeout),
+                                names*self.args.count, self.args.threads)
+        self.record('get', lat, err, T, channels=len(names))
+
+    def put(self):
+        names = ['bench:put:%d'%i for i in range(self.args.channels)]
+        with self.context() as ctxt:
+            ctxt.get(names, timeout=self.args.timeout) # connect
+            self.proc.cpu()
+            lat, err, T = drive(lambda name: ctxt.put(name, 1.0, timeout=self.args.timeout),
+                                names*self.args.count, self.args.threads)
+        self.record('put', lat, err, T, channels=len(names))
+
+    def monitor(self, pvname, nsubs):
+        """Latency from update timestamp to reception by each of nsubs downstream subscribers
+        """
+        nctxt = max(1, min(nsubs, self.args.contexts))
+        ctxts = [self.context() for _i in range(nctxt)]
+        lat, lock = [], threading.Lock()
+        done = threading.Event()
+
+        def cb(V):
+            now = time.time()
+            with lock:
+                if not done.is_set():
+                    lat.append(now - V.timestamp)
+
+        subs = []
+        try:
+            for i in range(nsubs):
+                subs.append(ctxts[i%nctxt].monitor(pvname, cb))
+
+            # wait for initial updates
+            time.sleep(min(1.0, self.args.duration))
+            with lock:
+                del lat[:]
+            self.proc.cpu()
+            T0 = _clock()
+            time.sleep(self.args.duration)
+            with lock:
+                done.set()
+                T = _clock()-T0
+        finally:
+            [S.close() for S in subs]
+            [C.close() for C in ctxts]
+
+        self.record('monitor:%s:%d'%(pvname, nsubs), lat, [], T,
+                    subscribers=nsubs, update_rate=self.args.rate)
+
+    def run(self):
+        S = self.args.scenario
+        if 'search' in S:
+            self.search()
+        if 'get' in S:
+            self.get()
+        if 'put' in S:
+            self.put()
+        if 'monitor' in S:
+            for nsubs in self.args.subscribers:
+                self.monitor('bench:mon', nsubs)
+                self.monitor('bench:wf', nsubs)
+
+        return {
+            'version':1,
+            'p4p':str(version),
+            'python':platform.python_version(),
+            'platform':platform.platform(),
+            'args':{k:v for k,v in vars(self.args).items() if k not in ('output', 'verbose')},
+            'results':self.results,
+        }
+
+def intlist(s):
+    return [int(v) for v in s.split(',')]
+
+def getbenchargs():
+    from argparse import ArgumentParser
+    P = ArgumentParser(description='Gateway benchmark')
+    P.add_argument('-O', '--output', default='-', help='Write JSON results to file.  Default stdout')
+    P.add_argument('--conf', help='Gateway config file (eg. loopback.conf)')
+    P.add_argument('--scenario', type=lambda s:s.split(','), default=['search', 'get', 'put', 'monitor'],
+                   help='Comma separated list of scenarios: search, get, put, monitor')
+    P.add_argument('--search', type=int, default=1000, help='Number of PVs to search for')
+    P.add_argument('--channels', type=int, default=10, help='Number of PVs for GET and PUT')
+    P.add_argument('--count', type=int, default=100, help='Operations per PV for GET and PUT')
+    P.add_argument('--threads', type=int, default=8, help='Concurrent client threads for search, GET and PUT')
+    P.add_argument('--subscribers', type=intlist, default=[1, 10, 100],
+                   help='Comma separated list of downstream subscriber counts')
+    P.add_argument('--contexts', type=int, default=8, help='Maximum number of downstream client contexts')
+    P.add_argument('--rate', type=float, default=100.0, help='Upstream monitor update rate (Hz)')
+    P.add_argument('--size', type=int, default=10000, help='Number of waveform elements')
+    P.add_argument('--duration', type=float, default=5.0, help='Seconds to measure each monitor scenario')
+    P.add_argument('--timeout', type=float, default=5.0, help='Operation timeout')
+    P.add_argument('-v', '--verbose', action='store_const', const=logging.DEBUG, default=logging.INFO)
+    return P
+
+def main(args=None):
+    args = getbenchargs().parse_args(args)
+    logging.basicConfig(level=args.verbose)
+
+    bench = Bench(args)
+    try:
+        R = bench.run()
+    finally:
+        bench.close()
+
+    if args.output=='-':
+        json.dump(R, sys.stdout, indent=1, sort_keys=True)
+        print()
+    else:
+        with open(args.output, 'w') as F:
+            json.dump(R, F, indent=1, sort_keys=True)
+
+if __name__=='__main__':
+    main()
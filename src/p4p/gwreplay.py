@@ -0,0 +1,230 @@
+"""Replay a Gateway workload capture
+
+Re-drives the searches and operations recorded by a Gateway with the "record"
+server option (cf. `p4p._gw.Provider.record`) against a loopback Gateway, as in `p4p.gwbench`.
+Recorded PV names are served by synthetic upstream PVs.  Names which were searched for
+but never connected are not served, so that search misses are also replayed. ::
+
+    python -m p4p.gwreplay capture.rec --speed 10 -O results.json
+"""
+
+from __future__ import print_function
+
+import sys
+import json
+import time
+import struct
+import logging
+import threading
+
+from .client import raw
+from .gwbench import Bench, _clock
+from . import _gw
+
+_log = logging.getLogger(__name__)
+
+MAGIC = b'P4PGWREC'
+VERSION = 1
+
+# cf. GWRecorder::event_t
+SEARCH, CREATE, INFO, GET, PUT, RPC, MONITOR = range(1, 8)
+EVENTS = {
+    SEARCH:'search',
+    CREATE:'create',
+    INFO:'info',
+    GET:'get',
+    PUT:'put',
+    RPC:'rpc',
+    MONITOR:'monitor',
+}
+
+_head = struct.Struct('<BQ')
+_strlen = struct.Struct('<H')
+
+def readRecording(F):
+    """Parse a capture from file-like F
+    Yields tuples (event, usec, peer, name, request)
+    """
+    header = F.read(12)
+    if len(header)!=12 or header[:8]!=MAGIC:
+        raise ValueError('Not a Gateway recording')
+    ver, = struct.unpack('<I', header[8:])
+    if ver!=VERSION:
+        raise ValueError('Unsupported recording version %d'%ver)
+
+    def getstr():
+        L, = _strlen.unpack(F.read(_strlen.size))
+        return F.read(L).decode('utf-8', 'replace')
+
+    while True:
+        buf = F.read(_head.size)
+        if len(buf)<_head.size:
+            break # EOF, or truncated by crash
+        try:
+            evt, usec = _head.unpack(buf)
+            yield evt, usec, getstr(), getstr(), getstr()
+        except struct.error:
+            break
+
+class Replay(Bench):
+    def __init__(self, args):
+        with open(args.recording, 'rb') as F:
+            self.events = list(readRecording(F))
+        _log.info('Read %d events from %s', len(self.events), args.recording)
+        super(Replay, self).__init__(args)
+
+    def load(self, S):
+        names = set(name for evt, _usec, _peer, name, _req in self.events if evt!=SEARCH)
+        # one Source, and one update thread, for all names
+        _gw.addLoadSource(S, 'replay', names=sorted(names), type=self.args.type, size=self.args.size,
+                          rate=self.args.rate, echo=True)
+
+    def run(self):
+        args = self.args
+        speed = args.speed
+        connected = set((peer, name) for evt, _usec, peer, name, _req in self.events if evt!=SEARCH)
+        searched = set()
+
+        lat = dict((evt, []) for evt in EVENTS)
+        errors = dict((evt, []) for evt in EVENTS)
+        pending = [0]
+        lock = threading.Lock()
+        idle = threading.Event()
+        idle.set()
+
+        ctxts = {}
+        ops = [] # keep alive until end of replay
+
+        def done(evt, T0, V):
+            with lock:
+                if isinstance(V, Exception):
+                    if not isinstance(V, raw.Cancelled):
+                        errors[evt].append(str(V))
+                else:
+                    lat[evt].append(_clock()-T0)
+                pending[0] -= 1
+                if pending[0]==0:
+                    idle.set()
+
+        def issue(evt, T0):
+            with lock:
+                pending[0] += 1
+                idle.clear()
+            return lambda V: done(evt, T0, V)
+
+        def monitor(evt, T0, sub):
+            first = [True]
+            def cb():
+                while True:
+                    V = sub[0].pop() if sub else None
+                    if V is None:
+                        break
+                    if first[0]:
+                        first[0] = False
+                        done(evt, T0, V)
+            return cb
+
+        self.proc.cpu()
+        T0 = _clock()
+        try:
+            for evt, usec, peer, name, req in self.events:
+                if speed>0:
+                    delay = T0 + usec*1e-6/speed - _clock()
+                    if delay>0:
+                        time.sleep(delay)
+
+                if evt==CREATE:
+                    continue # implied by first operation
+                elif evt==SEARCH and ((peer, name) in connected or (peer, name) in searched):
+                    continue # implied by first operation, or retry
+
+                ctxt = ctxts.get(peer)
+                if ctxt is None:
+                    # one client context for each recorded client
+                    ctxt = ctxts[peer] = raw.Context('pva', conf=self.dsconf, useenv=False)
+
+                req = req or None
+                now = _clock()
+                if evt==SEARCH:
+                    # never connects.  Searches until end of replay.
+                    searched.add((peer, name))
+                    ops.append(ctxt.get(name, lambda V:None))
+                elif evt in (INFO, GET):
+                    ops.append(ctxt.get(name, issue(evt, now), request=req))
+                elif evt==PUT:
+                    ops.append(ctxt.put(name, issue(evt, now), builder=0.0, request=req, get=False))
+                elif evt==RPC:
+                    ops.append(ctxt.rpc(name, issue(evt, now), None, request=req))
+                elif evt==MONITOR:
+                    issue(evt, now) # completes with first update
+                    sub = []
+                    cb = monitor(evt, now, sub)
+                    sub.append(ctxt.monitor(name, cb, request=req))
+                    ops.append(sub[0])
+                    cb() # in case first update arrived before append()
+                else:
+                    _log.warning('Ignore unknown event %d', evt)
+
+            # wait for outstanding operations
+            idle.wait(args.timeout)
+            T = _clock()-T0
+
+        finally:
+            for op in ops:
+                if isinstance(op, raw.Subscription):
+                    op.close()
+                else:
+                    op.cancel()
+            [C.close() for C in ctxts.values()]
+
+        with lock:
+            incomplete = pending[0]
+
+        for evt, name in EVENTS.items():
+            if lat[evt] or errors[evt]:
+                self.record(name, lat[evt], errors[evt], T)
+
+        return {
+            'version':1,
+            'recording':args.recording,
+            'events':len(self.events),
+            'clients':len(ctxts),
+            'incomplete':incomplete,
+            'args':{k:v for k,v in vars(args).items() if k not in ('output', 'verbose')},
+            'results':self.results,
+        }
+
+def getreplayargs():
+    from argparse import ArgumentParser
+    P = ArgumentParser(description='Replay Gateway workload capture')
+    P.add_argument('recording', help='Capture file')
+    P.add_argument('-O', '--output', default='-', help='Write JSON results to file.  Default stdout')
+    P.add_argument('--conf', help='Gateway config file (eg. loopback.conf)')
+    P.add_argument('--speed', type=float, default=1.0,
+                   help='Replay speed relative to capture.  eg. 10 for 10x.  0 for as fast as possible')
+    P.add_argument('--type', default='scalar', help='Type of upstream PVs: scalar, waveform, ndarray, or table')
+    P.add_argument('--size', type=int, default=1, help='Size of upstream PVs.  cf. p4p._gw.addLoadSource')
+    P.add_argument('--rate', type=float, default=1.0, help='Upstream monitor update rate (Hz)')
+    P.add_argument('--timeout', type=float, default=5.0, help='Wait for outstanding operations after replay')
+    P.add_argument('-v', '--verbose', action='store_const', const=logging.DEBUG, default=logging.INFO)
+    return P
+
+def main(args=None):
+    args = getreplayargs().parse_args(args)
+    logging.basicConfig(level=args.verbose)
+
+    replay = Replay(args)
+    try:
+        R = replay.run()
+    finally:
+        replay.close()
+
+    if args.output=='-':
+        json.dump(R, sys.stdout, indent=1, sort_keys=True)
+        print()
+    else:
+        with open(args.output, 'w') as F:
+            json.dump(R, F, indent=1, sort_keys=True)
+
+if __name__=='__main__':
+    main()
@@ -20,6 +20,7 @@ import time
 import numpy
 
 from ..wrapper import Type, Value
+from .._p4p import unwrapNDArray
 from .common import alarm, timeStamp, NTBase
 
 from .scalar import ntwrappercommon
@@ -47,8 +48,13 @@ class ntndarray(ntwrappercommon, numpy.ndarray):
         super(ntndarray, self).__init__(*args, **kws)
         self.attrib = {}
 
-    def _store(self, value):
+    def _store(self, value, attrib=None):
         ntwrappercommon._store(self, value)
+        if attrib is not None:
+            # already shaped by unwrapNDArray()
+            self.attrib = attrib
+            return self
+
         self.attrib = {}
         for elem in value.get('attribute', []):
             self.attrib[elem.name] = elem.value
@@ -168,7 +174,9 @@ class NTNDArray(NTBase):
         dataSize = value.nbytes
 
         return self._annotate(Value(self.type, {
-            'value': (self._code2u[value.dtype.char], value.flatten()),
+            # ravel() is a view of contiguous input.  Assignment then shares pixels which are
+            # already immutable, eg. from unwrap(), and copies others.
+            'value': (self._code2u[value.dtype.char], value.ravel()),
             'compressedSize': dataSize,
             'uncompressedSize': dataSize,
             'uniqueId': 0,
@@ -183,12 +191,14 @@ class NTNDArray(NTBase):
     @classmethod
     def unwrap(klass, value):
         """Unwrap Value as NTNDArray
+
+        The returned array is a read-only view of the ``value`` field, shaped by ``dimension[].size``.
+        Use ``.copy()`` to obtain a modifiable array.
         """
-        V = value.value
-        if V is None:
-            # Union empty.  treat as zero-length char array
-            V = numpy.zeros((0,), dtype=numpy.uint8)
-        return V.view(klass.ntndarray)._store(value)
+        # Shaped view of the pixel array without copying.
+        # Union empty is treated as zero-length char array.
+        V, attrib = unwrapNDArray(value)
+        return V.view(klass.ntndarray)._store(value, attrib)
 
     def assign(self, V, py):
         """Store python value in Value
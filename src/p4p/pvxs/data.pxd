@@ -132,6 +132,7 @@ cdef extern from "<pvxs/data.h>" namespace "pvxs" nogil:
         bool idStartsWith(const string&) except+
 
         bool equalInst(const Value&)
+        bool equalType(const Value&)
 
         const string& nameOf(const Value&) except+
 
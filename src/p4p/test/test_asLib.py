@@ -14,9 +14,8 @@ from .. import nt
 
 _log = logging.getLogger(__name__)
 
-class TestPVList(unittest.TestCase):
-    def test_slac(self):
-        pvlist = r"""
+# shared with the pvagwd test in test_gw
+slacPVList = r"""
 EVALUATION ORDER ALLOW, DENY
 # comment
 .* ALLOW 
@@ -36,21 +35,67 @@ a:([^:]*):b:([^:]*) ALIAS A:\2:B:\1
 
 """
 
-        pvl = PVList(pvlist)
+# [((pv, host), (usname, asg, asl))]
+slacPVListCases = [
+    (('BEAM:stuff', '127.0.0.1'), ('BEAM:stuff', 'RWINSTRMCC', 1)),
+    # DENY FROM is ignored as a later line repeats the pattern
+    (('BEAM:stuff', '1.2.3.4'), ('BEAM:stuff', 'RWINSTRMCC', 1)),
+    (('BEAM:L1:Energy', '127.0.0.1'), ('BEAM:L1:Energy', 'DEFAULT', 0)),
+    (('OTHER:stuff', '127.0.0.1'), ('OTHER:stuff', 'DEFAULT', 0)),
+    (('OTRS:DMP1:695:Image:X', '127.0.0.1'), (None, None, None)),
+    (('PATT:SYS0:1:MPSBURSTCTRLX', '127.0.0.1'), ('PATT:SYS0:1:MPSBURSTCTRLX', 'CANWRITE', 0)),
+    (('PATT:SYS0:1:MPSBURSTCTRLX', '1.2.3.4'), (None, None, None)),
+    (('PATT:SYS0:1:MPSBURSTCTRLX', '4.3.2.1'), (None, None, None)),
+    (('Xsomething', '127.0.0.1'), ('Ysomething', 'CANWRITE', 0)),
+    (('THIS', '127.0.0.1'), ('THAT', 'DEFAULT', 0)),
+    (('a:one:b:two', '127.0.0.1'), ('A:two:B:one', 'DEFAULT', 0)),
+]
 
-        self.assertEqual(pvl.compute(b'BEAM:stuff', '127.0.0.1'), ('BEAM:stuff', 'RWINSTRMCC', 1))
-        self.assertEqual(pvl.compute(b'BEAM:L1:Energy', '127.0.0.1'), ('BEAM:L1:Energy', 'DEFAULT', 0))
+class TestPVList(unittest.TestCase):
+    def test_slac(self):
+        pvl = PVList(slacPVList)
 
-        self.assertEqual(pvl.compute(b'OTHER:stuff', '127.0.0.1'), ('OTHER:stuff', 'DEFAULT', 0))
+        for (pv, host), expect in slacPVListCases:
+            self.assertEqual(pvl.compute(pv.encode(), host), expect, (pv, host))
 
-        self.assertEqual(pvl.compute(b'OTRS:DMP1:695:Image:X', '127.0.0.1'), (None, None, None))
+    def test_affected(self):
+        old = PVList(r"""
+.* ALLOW
+BEAM:.* ALLOW RWBEAM 1
+X(.*) ALIAS Y\1
+SECRET:.* DENY
+""")
+        same = PVList(r"""
+.* ALLOW
+BEAM:.* ALLOW RWBEAM 1
+X(.*) ALIAS Y\1
+SECRET:.* DENY
+""")
+        new = PVList(r"""
+.* ALLOW
+BEAM:.* ALLOW RWBEAM 0
+X(.*) ALIAS Y\1
+SECRET:.* DENY FROM 1.2.3.4
+""")
+        reorder = PVList(r"""
+.* ALLOW
+X(.*) ALIAS Y\1
+BEAM:.* ALLOW RWBEAM 1
+SECRET:.* DENY
+""")
+
+        affected = same.affected(old)
+        self.assertFalse(affected('BEAM:stuff'))
+        self.assertFalse(affected('Xstuff'))
 
-        self.assertEqual(pvl.compute(b'PATT:SYS0:1:MPSBURSTCTRLX', '127.0.0.1'), ('PATT:SYS0:1:MPSBURSTCTRLX', 'CANWRITE', 0))
-        self.assertEqual(pvl.compute(b'PATT:SYS0:1:MPSBURSTCTRLX', '1.2.3.4'), (None, None, None))
-        self.assertEqual(pvl.compute(b'PATT:SYS0:1:MPSBURSTCTRLX', '4.3.2.1'), (None, None, None))
+        affected = new.affected(old)
+        self.assertTrue(affected('BEAM:stuff'))
+        self.assertTrue(affected('SECRET:stuff'))
+        self.assertFalse(affected('Xstuff'))
+        self.assertFalse(affected('OTHER:stuff'))
 
-        self.assertEqual(pvl.compute(b'Xsomething', '127.0.0.1'), ('Ysomething', 'CANWRITE', 0))
-        self.assertEqual(pvl.compute(b'a:one:b:two', '127.0.0.1'), ('A:two:B:one', 'DEFAULT', 0))
+        affected = reorder.affected(old)
+        self.assertTrue(affected('OTHER:stuff'))
 
 class LocalSubscription(object):
     def __init__(self, cb, code='d'):
@@ -195,6 +240,124 @@ ASG(DEFAULT)
             except AssertionError as e:
                 raise AssertionError('%s -> %s : %s'%(args, perm ,e))
 
+    def test_memo(self):
+        eng = DummyEngine("""
+UAG(SPECIAL) {
+    root
+}
+ASG(DEFAULT)
+{
+        RULE(1,READ)
+        RULE(1,WRITE) {
+            UAG(SPECIAL)
+        }
+}
+""")
+        A, B, C = self.DummyChannel(), self.DummyChannel(), self.DummyChannel()
+        eng.create(A, 'DEFAULT', 'root', '1.2.3.4', 0)
+        eng.create(B, 'DEFAULT', 'root', '1.2.3.4', 0)
+        eng.create(C, 'DEFAULT', 'someone', '1.2.3.4', 0)
+        self.assertDictEqual(A.perm, {'put':True, 'rpc':True, 'uncached':False, 'audit': False})
+        self.assertDictEqual(B.perm, A.perm)
+        self.assertDictEqual(C.perm, {'put':False,'rpc':False, 'uncached':False, 'audit': False})
+        self.assertEqual(len(eng._perms), 2)
+
+        eng.parse("""
+ASG(DEFAULT)
+{
+        RULE(1,READ)
+}
+""")
+        self.assertDictEqual(A.perm, {'put':False,'rpc':False, 'uncached':False, 'audit': False})
+        self.assertDictEqual(B.perm, A.perm)
+        self.assertDictEqual(C.perm, A.perm)
+        self.assertEqual(len(eng._perms), 2)
+
+    def test_reparse(self):
+        eng = DummyEngine("""
+UAG(SPECIAL) {
+    root,
+    "role/admin"
+}
+ASG(DEFAULT)
+{
+        RULE(1,READ)
+}
+ASG(RW)
+{
+        RULE(1,READ)
+        RULE(1,WRITE) {
+            UAG(SPECIAL)
+        }
+}
+""")
+        ro, rw = self.DummyChannel(), self.DummyChannel()
+        eng.create(ro, 'DEFAULT', 'someone', 'somewhere', 0, ['admin'])
+        eng.create(rw, 'RW', 'someone', 'somewhere', 0, ['admin'])
+        self.assertDictEqual(ro.perm, {'put':False,'rpc':False, 'uncached':False, 'audit': False})
+        self.assertDictEqual(rw.perm, {'put':True, 'rpc':True, 'uncached':False, 'audit': False})
+
+        # unchanged ASG is not re-evaluated
+        ro.perm = rw.perm = None
+        eng.parse("""
+UAG(SPECIAL) {
+    root,
+    "role/admin"
+}
+ASG(DEFAULT)
+{
+        RULE(1,READ)
+}
+ASG(RW)
+{
+        RULE(1,READ)
+        RULE(1,WRITE) {
+            UAG(SPECIAL)
+        }
+}
+""")
+        self.assertIsNone(ro.perm)
+        self.assertIsNone(rw.perm)
+
+        # UAG membership change re-evaluates ASG which references it, retaining roles
+        eng.parse("""
+UAG(SPECIAL) {
+    root
+}
+ASG(DEFAULT)
+{
+        RULE(1,READ)
+}
+ASG(RW)
+{
+        RULE(1,READ)
+        RULE(1,WRITE) {
+            UAG(SPECIAL)
+        }
+}
+""")
+        self.assertIsNone(ro.perm)
+        self.assertDictEqual(rw.perm, {'put':False,'rpc':False, 'uncached':False, 'audit': False})
+
+        eng.parse("""
+UAG(SPECIAL) {
+    root,
+    "role/admin"
+}
+ASG(DEFAULT)
+{
+        RULE(1,READ)
+}
+ASG(RW)
+{
+        RULE(1,READ)
+        RULE(1,WRITE) {
+            UAG(SPECIAL)
+        }
+}
+""")
+        self.assertDictEqual(rw.perm, {'put':True, 'rpc':True, 'uncached':False, 'audit': False})
+
     def test_slac(self):
         eng = DummyEngine("""
 UAG(PHOTON)
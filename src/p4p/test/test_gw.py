@@ -1,4 +1,5 @@
 import logging
+import os
 import warnings
 import platform
 import unittest
@@ -6,6 +7,12 @@ import gc
 import json
 import weakref
 import threading
+import time
+import socket
+import signal
+import subprocess
+
+import numpy
 
 try: # 2.7
     from Queue import Queue, Full, Empty
@@ -25,7 +32,7 @@ from ..server.thread import SharedPV, _defaultWorkQueue
 from ..client import raw
 from ..client.thread import Context, Disconnected, TimeoutError, RemoteError
 from ..nt import NTScalar
-from ..gw import App, main, getargs
+from ..gw import App, main, getargs, parseCPUs, threadPlacement, ThreadAffinity
 
 from .. import _gw
 
@@ -67,6 +74,92 @@ class TestTemplate(unittest.TestCase):
             self.assertRegex(content, '-m p4p.gw /etc/pvagw/%i.conf')
             self.assertRegex(content, 'multi-user.target')
 
+class Stall(object):
+    """Monitor callback which stops reading after each update until released
+    """
+    def __init__(self, timeout):
+        self.Q, self.gate, self.timeout = Queue(), threading.Event(), timeout
+    def __call__(self, V):
+        self.Q.put(V)
+        if not isinstance(V, Disconnected):
+            self.gate.wait(self.timeout)
+
+def postUntil(pv, cond, timeout, start=100):
+    """post() increasing values until cond() returns True.  Returns the last value posted
+    """
+    deadline = monotonic()+timeout
+    val = start
+    while monotonic()<deadline:
+        val += 1
+        pv.post(val)
+        if cond():
+            return val
+        time.sleep(0.01)
+    raise AssertionError('Timeout after posting %d'%val)
+
+class TestAffinity(unittest.TestCase):
+    def test_parse(self):
+        self.assertSetEqual(parseCPUs('3'), {3})
+        self.assertSetEqual(parseCPUs('0-3,8'), {0, 1, 2, 3, 8})
+        self.assertSetEqual(parseCPUs(' 1 , 4-5\n'), {1, 4, 5})
+        self.assertRaises(ValueError, parseCPUs, '')
+        self.assertRaises(ValueError, parseCPUs, '3-1')
+        self.assertRaises(ValueError, parseCPUs, 'x')
+
+    @unittest.skipUnless(hasattr(os, 'sched_getaffinity'), 'Linux only')
+    def test_placement(self):
+        threads = threadPlacement()
+        # main thread ID is the process ID
+        self.assertIn(os.getpid(), [tid for _name, tid, _allowed, _cpu, _node in threads])
+        for name, tid, allowed, cpu, node in threads:
+            self.assertTrue(parseCPUs(allowed))
+
+    @unittest.skipUnless(hasattr(os, 'sched_getaffinity') and hasattr(threading, 'get_native_id'), 'Linux only')
+    def test_pin(self):
+        orig = os.sched_getaffinity(0)
+        if len(orig)<2:
+            raise unittest.SkipTest('Requires more than one CPU')
+        target = max(orig)
+
+        ready, wake, done, release = [threading.Event() for _i in range(4)]
+        info = {}
+        def worker():
+            tid = info['tid'] = threading.get_native_id()
+            with open('/proc/self/task/%d/comm'%tid, 'w') as F:
+                F.write('p4ptestpin')
+            ready.set()
+            wake.wait(10)
+            sum(range(100000)) # run after pinning
+            info['affinity'] = os.sched_getaffinity(0) # of this thread
+            done.set()
+            release.wait(10)
+
+        T = threading.Thread(target=worker, name='p4ptestpin')
+        T.start()
+        try:
+            self.assertTrue(ready.wait(10))
+
+            ThreadAffinity([('p4ptestpin', str(target))]).apply()
+            wake.set()
+            self.assertTrue(done.wait(10))
+
+            [(name, _tid, allowed, cpu, _node)] = [ent for ent in threadPlacement() if ent[1]==info['tid']]
+            self.assertEqual(name, 'p4ptestpin')
+            self.assertSetEqual(parseCPUs(allowed), {target})
+            self.assertEqual(cpu, target)
+            self.assertSetEqual(info['affinity'], {target})
+
+            # other threads not changed
+            self.assertSetEqual(os.sched_getaffinity(0), orig)
+        finally:
+            try:
+                os.sched_setaffinity(info['tid'], orig)
+            except (KeyError, OSError):
+                pass
+            wake.set()
+            release.set()
+            T.join(10)
+
 class TestGC(RefTestCase):
     def test_empty(self):
         class Dummy(object):
@@ -117,6 +210,7 @@ class TestGC(RefTestCase):
 
 class TestLowLevel(RefTestCase):
     timeout = 5
+    shards = 1
 
     class Handler(object):
         def testChannel(self, pvname, peer):
@@ -124,6 +218,8 @@ class TestLowLevel(RefTestCase):
             if pvname in (b'pv:ro', b'pv:rw'):
                 # Add to, and test, channel cache.  Return True if client channel is available
                 ret = self.provider.testChannel(b'pv:name')
+            elif pvname==b'pv:array':
+                ret = self.provider.testChannel(b'pv:array')
             else:
                 ret = self.provider.BanPV
             _log.debug("GW Search %r from %r -> %s", pvname, peer, ret)
@@ -132,7 +228,7 @@ class TestLowLevel(RefTestCase):
         def makeChannel(self, op):
             try:
                 # try to create from cache.  Does not add
-                chan = op.create(b'pv:name')
+                chan = op.create(b'pv:array' if op.name==b'pv:array' else b'pv:name')
                 put = False
                 if op.name==b'pv:rw':
                     put = True
@@ -149,10 +245,13 @@ class TestLowLevel(RefTestCase):
         super(TestLowLevel, self).setUp()
 
         # upstream server
-        self.pv = SharedPV(nt=NTScalar('i'), initial=42)
+        self.pv = SharedPV(nt=NTScalar('i', valueAlarm=True), initial=42)
         self._us_provider = StaticProvider('upstream')
         self._us_provider.add('pv:name', self.pv)
 
+        self.arr = SharedPV(nt=NTScalar('ad'), initial=numpy.zeros(1<<20))
+        self._us_provider.add('pv:array', self.arr)
+
         @self.pv.put
         def put(pv, op):
             _log.debug("PUT %s", op.value())
@@ -165,7 +264,7 @@ class TestLowLevel(RefTestCase):
         # placed weakref in global registry
         H = self.Handler()
         CLI = raw.Context(u'pva', self._us_server.conf())
-        H.provider = self.gw = _gw.Provider(u'gateway', CLI, H)
+        H.provider = self.gw = _gw.Provider(u'gateway', CLI, H, shards=self.shards)
 
         # GW server side
         self._ds_server = Server(providers=[H.provider], isolate=True)
@@ -184,6 +283,7 @@ class TestLowLevel(RefTestCase):
         del self._us_provider
         del self._us_server
         del self.pv
+        del self.arr
         _defaultWorkQueue.sync()
         gc.collect()
 
@@ -204,6 +304,116 @@ class TestLowLevel(RefTestCase):
         val = self._ds_client.get('pv:ro', timeout=self.timeout)
         self.assertEqual(val, 43)
 
+    def test_cache_budget(self):
+        val = self._ds_client.get('pv:ro', timeout=self.timeout)
+        self.assertEqual(val, 42)
+
+        S = self.gw.stats()
+        self.assertEqual(S['ccacheSize.value'], 1)
+        self.assertEqual(S['gcacheSize.value'], 1)
+        self.assertGreater(S['gcacheBytes.value'], 0)
+        _M, G = self.gw.cached('pv:name')
+        self.assertEqual(G.value, 42)
+
+        # any cached value is over budget
+        self.gw.cacheBudget(1)
+        self.gw.sweep()
+
+        S = self.gw.stats()
+        self.assertEqual(S['ccacheSize.value'], 1) # channel is still in use
+        self.assertEqual(S['gcacheBytes.value'], 0)
+        self.assertEqual(S['mcacheBytes.value'], 0)
+        _M, G = self.gw.cached('pv:name')
+        self.assertListEqual(list(G.changedSet()), []) # emptied
+
+        # next GET must fetch a complete value from upstream
+        self.pv.post(43)
+        val = self._ds_client.get('pv:ro', timeout=self.timeout)
+        self.assertEqual(val, 43)
+
+        S = self.gw.stats()
+        self.assertGreater(S['gcacheBytes.value'], 0)
+        _M, G = self.gw.cached('pv:name')
+        self.assertEqual(G.value, 43)
+        self.assertIn('value', G.changedSet())
+
+        self.gw.cacheBudget(0)
+        del _M, G
+
+    def test_record(self):
+        from ..gwreplay import readRecording, SEARCH, CREATE, GET, MONITOR
+
+        with NamedTemporaryFile() as F:
+            self.gw.record(F.name)
+
+            val = self._ds_client.get('pv:ro', request='field(value)', timeout=self.timeout)
+            self.assertEqual(val, 42)
+
+            Q = Queue()
+            with self._ds_client.monitor('pv:ro', Q.put):
+                self.assertEqual(Q.get(timeout=self.timeout), 42)
+
+            self.gw.record(None)
+
+            with open(F.name, 'rb') as R:
+                events = list(readRecording(R))
+
+        _log.debug("Recorded %s", events)
+        evts = [evt for evt, _usec, _peer, name, _req in events if name=='pv:ro']
+        self.assertIn(SEARCH, evts)
+        self.assertIn(CREATE, evts)
+        self.assertLess(evts.index(SEARCH), evts.index(CREATE))
+        self.assertIn(MONITOR, evts)
+
+        gets = [req for evt, _usec, _peer, name, req in events if evt==GET]
+        self.assertEqual(len(gets), 1)
+        self.assertTrue(gets[0].startswith('field(value)'), gets[0])
+
+    def test_search_limit(self):
+        self.gw.searchLimit(0.001, 1)
+        try:
+            # first name admitted
+            val = self._ds_client.get('pv:ro', timeout=self.timeout)
+            self.assertEqual(val, 42)
+
+            # no tokens remain for another
+            with self.assertRaises(TimeoutError):
+                self._ds_client.get('pv:rw', timeout=1.0)
+
+            drops = self.gw.searchDrops()
+            self.assertEqual(len(drops), 1)
+            self.assertEqual(drops[0][0], '127.0.0.1')
+            self.assertGreaterEqual(drops[0][1], 1)
+            self.assertGreaterEqual(self.gw.stats()['searchDrops'], 1)
+
+        finally:
+            self.gw.searchLimit(0)
+
+        self.assertListEqual(self.gw.searchDrops(), [])
+        val = self._ds_client.get('pv:rw', timeout=self.timeout)
+        self.assertEqual(val, 42)
+
+    def test_warm(self):
+        from ..gw import saveCache, warmCache
+
+        self.assertEqual(self.gw.warm(['pv:name', 'pv:array'], self.timeout), 2)
+        self.assertSetEqual(self.gw.cachePeek(), {b'pv:name', b'pv:array'})
+
+        val = self._ds_client.get('pv:ro', timeout=self.timeout)
+        self.assertEqual(val, 42)
+
+        snap = self.gw.cacheSnapshot()
+        self.assertEqual(len(snap), 2)
+        self.assertEqual(snap[0][0], 'pv:name') # most recent
+
+        with NamedTemporaryFile() as F:
+            saveCache(self.gw, F.name)
+            with open(F.name, 'r') as R:
+                saved = json.load(R)
+            self.assertEqual(saved['names'][0][0], 'pv:name')
+
+            warmCache(self.gw, F.name, 1, self.timeout)
+
     def test_ban(self):
         with self.assertRaises(TimeoutError):
             self._ds_client.put('invalid', 40, timeout=0.1)
@@ -250,6 +460,179 @@ class TestLowLevel(RefTestCase):
                 with self.assertRaises(Empty):
                     Q2.get(timeout=0.01)
 
+                # both subscribers keeping up
+                self.assertListEqual(self.gw.slowConsumers(), [])
+
+    def test_array_shared(self):
+        """Large array updates pass through the monitor and GET caches without copying
+        """
+        Q = Queue(maxsize=4)
+
+        with self._ds_client.monitor('pv:array', Q.put, notify_disconnect=True):
+            self.assertIsInstance(Q.get(timeout=self.timeout), Disconnected)
+            self.assertEqual(Q.get(timeout=self.timeout).shape, (1<<20,))
+
+            prev = None
+            for i in range(1, 4):
+                self.arr.post(numpy.arange(1<<20)+i)
+                V = Q.get(timeout=self.timeout)
+                self.assertEqual(V[0], i)
+
+                V = self._ds_client.get('pv:array', timeout=self.timeout)
+                self.assertEqual(V[0], i)
+
+                # copies of the cache share array storage
+                M1, G1 = self.gw.cached('pv:array')
+                M2, G2 = self.gw.cached('pv:array')
+                self.assertEqual(M1.value[0], i)
+                self.assertEqual(G1.value[0], i)
+                self.assertEqual(M1.value.ctypes.data, M2.value.ctypes.data)
+                self.assertEqual(G1.value.ctypes.data, G2.value.ctypes.data)
+                # each update replaces
+                self.assertNotEqual(M1.value.ctypes.data, prev)
+                prev = M1.value.ctypes.data
+
+            # an update without 'value' leaves the cached array in place
+            self.arr.post({'alarm':{'severity':1}})
+            self.assertEqual(Q.get(timeout=self.timeout).severity, 1)
+            M3, _G = self.gw.cached('pv:array')
+            self.assertEqual(M3.value.ctypes.data, prev)
+            del M1, M2, M3, G1, G2, _G
+
+        self.assertTupleEqual(self.gw.cached('invalid'), (None, None))
+
+    def test_array_slice(self):
+        Q = Queue(maxsize=4)
+
+        with self._ds_client.monitor('pv:array', Q.put, request='record[slice=0:1024:-1,decimate=max]field()',
+                                     notify_disconnect=True):
+            self.assertIsInstance(Q.get(timeout=self.timeout), Disconnected)
+            self.assertEqual(Q.get(timeout=self.timeout).shape, (1024,))
+
+            self.arr.post(numpy.arange(1<<20))
+            V = Q.get(timeout=self.timeout)
+            self.assertListEqual(list(V), list(range(1023, 1<<20, 1024)))
+
+    def test_deadband(self):
+        Q = Queue(maxsize=4)
+
+        with self._ds_client.monitor('pv:ro', Q.put, request='record[deadband=5]field()', notify_disconnect=True):
+            self.assertIsInstance(Q.get(timeout=self.timeout), Disconnected)
+            self.assertEqual(Q.get(timeout=self.timeout), 42)
+
+            self.pv.post(43) # suppressed
+            self.pv.post(50)
+            self.assertEqual(Q.get(timeout=self.timeout), 50)
+
+            with self.assertRaises(Empty):
+                Q.get(timeout=0.1)
+
+            # changes to other fields are always delivered, even with value inside deadband
+            self.pv.post({'value':51, 'valueAlarm':{'highAlarmLimit':100}})
+            V = Q.get(timeout=self.timeout)
+            self.assertEqual(V.raw['valueAlarm.highAlarmLimit'], 100)
+
+            # only valueAlarm changed
+            self.pv.post({'valueAlarm':{'highAlarmLimit':101}})
+            V = Q.get(timeout=self.timeout)
+            self.assertEqual(V.raw['valueAlarm.highAlarmLimit'], 101)
+            self.assertEqual(V, 51)
+
+            # any alarm change is delivered, even with value inside deadband
+            self.pv.post({'value':52, 'alarm':{'status':1}})
+            V = Q.get(timeout=self.timeout)
+            self.assertEqual((V, V.raw.alarm.status), (52, 1))
+
+            self.pv.post({'value':53, 'alarm':{'message':'hello'}})
+            V = Q.get(timeout=self.timeout)
+            self.assertEqual((V, V.raw.alarm.message), (53, 'hello'))
+
+            self.pv.post({'value':54, 'alarm':{'severity':1}})
+            V = Q.get(timeout=self.timeout)
+            self.assertEqual((V, V.raw.alarm.severity), (54, 1))
+
+            # unchanged alarm, value inside deadband
+            self.pv.post({'value':55, 'alarm':{'severity':1, 'status':1, 'message':'hello'}})
+            with self.assertRaises(Empty):
+                Q.get(timeout=0.1)
+
+    def test_slow_policy(self):
+        self.gw.slowPolicy(u'disconnect', 10)
+        self.gw.slowPolicy(u'squash')
+
+        with self.assertRaises(ValueError):
+            self.gw.slowPolicy(u'disconnect', 0)
+        with self.assertRaises(ValueError):
+            self.gw.slowPolicy(u'invalid')
+
+    def test_slow_squash(self):
+        S = Stall(self.timeout)
+        # pipeline so that the server queue fills when the client stops reading
+        try:
+            with self._ds_client.monitor('pv:ro', S, request='record[queueSize=2,pipeline=true]field()'):
+                self.assertEqual(S.Q.get(timeout=self.timeout), 42)
+
+                def squashed():
+                    slow = self.gw.slowConsumers()
+                    return len(slow)==1 and slow[0][5]>=3
+                last = postUntil(self.pv, squashed, self.timeout)
+
+                [(usname, dsname, peer, nQ, limQ, nSq)] = self.gw.slowConsumers()
+                self.assertEqual((usname, dsname), ('pv:name', 'pv:ro'))
+                self.assertGreater(limQ, 0)
+                self.assertLessEqual(nQ, limQ)
+                self.assertGreaterEqual(nSq, 3)
+
+                # once reading resumes, the latest value is delivered
+                S.gate.set()
+                while S.Q.get(timeout=self.timeout)!=last:
+                    pass
+
+                # squash count is retained
+                [ent] = self.gw.slowConsumers()
+                self.assertGreaterEqual(ent[5], nSq)
+        finally:
+            S.gate.set()
+
+    def test_slow_disconnect(self):
+        self.gw.slowPolicy(u'disconnect', 3)
+        S = Stall(self.timeout)
+        try:
+            with self._ds_client.monitor('pv:ro', S, request='record[queueSize=2,pipeline=true]field()',
+                                         notify_disconnect=True):
+                self.assertIsInstance(S.Q.get(timeout=self.timeout), Disconnected)
+                self.assertEqual(S.Q.get(timeout=self.timeout), 42)
+
+                # squashed, then removed when the downstream channel is closed
+                seen = []
+                def dropped():
+                    slow = self.gw.slowConsumers()
+                    if slow:
+                        seen.append(slow[0][5])
+                    return bool(seen) and not slow
+                postUntil(self.pv, dropped, self.timeout)
+                self.assertGreater(max(seen), 0)
+
+                S.gate.set()
+                while not isinstance(S.Q.get(timeout=self.timeout), Disconnected):
+                    pass
+        finally:
+            S.gate.set()
+            self.gw.slowPolicy(u'squash')
+
+class TestLowLevelSharded(TestLowLevel):
+    shards = 3
+
+    def test_shards(self):
+        self.assertEqual(self.gw.warm(['pv:name', 'pv:array'], self.timeout), 2)
+
+        self.assertEqual(self._ds_client.get('pv:ro', timeout=self.timeout), 42)
+
+        stats = self.gw.shardStats()
+        self.assertEqual(len(stats), 3)
+        self.assertEqual(sum(ent[0] for ent in stats), 2) # channels
+        self.assertEqual(sum(ent[1] for ent in stats), 2) # connected
+
 class TestApp(App):
     def __init__(self, args):
         super(TestApp, self).__init__(args)
@@ -265,6 +648,9 @@ class TestApp(App):
 class TestHighLevel(RefTestCase):
     timeout = 10
     getholdoff=None
+    pvlist = None # file content
+    slowpolicy = 'squash'
+    slowlimit = 100
     maxDiff = 4096
 
     def setUp(self):
@@ -316,6 +702,9 @@ class TestHighLevel(RefTestCase):
                 'bcastport':0,
                 'serverport':0,
                 'getholdoff':self.getholdoff,
+                'slowpolicy':self.slowpolicy,
+                'slowlimit':self.slowlimit,
+                'pvlist':self.writePVList(self.pvlist) if self.pvlist else '',
             }],
         }, cfile)
         cfile.flush()
@@ -331,6 +720,13 @@ class TestHighLevel(RefTestCase):
         self._main.start()
         return self._app.servers[u'server1_0'].conf()
 
+    def writePVList(self, content):
+        if getattr(self, '_pvlistfile', None) is None:
+            self._pvlistfile = NamedTemporaryFile(mode='w+')
+        with open(self._pvlistfile.name, 'w') as F:
+            F.write(content)
+        return self._pvlistfile.name
+
     def startServer(self):
         if self._us_server is None:
             if self._us_conf is None:
@@ -584,6 +980,177 @@ class TestHighLevelGetHoldOff(TestHighLevel):
 
             N = Vmax+1
 
+class TestHighLevelSlow(TestHighLevel):
+    slowpolicy = 'disconnect'
+    slowlimit = 1000 # squash, but do not disconnect, during this test
+
+    def test_slow_table(self):
+        S = Stall(self.timeout)
+        try:
+            with self._ds_client.monitor('pv:name', S, request='record[queueSize=2,pipeline=true]field()'):
+                self.assertEqual(S.Q.get(timeout=self.timeout), 42)
+
+                def squashed():
+                    slow = [ent for handler in self._app.stats.handlers for ent in handler.provider.slowConsumers()]
+                    return len(slow)==1 and slow[0][5]>0
+                postUntil(self.pv, squashed, self.timeout)
+
+                self._app.stats.update_stats(1.0)
+                tbl = self._app.stats.tbl_dsslow.current().value
+                self.assertListEqual(list(tbl.name), ['pv:name'])
+                self.assertGreater(tbl.squash[0], 0)
+                self.assertGreater(tbl.limit[0], 0)
+        finally:
+            S.gate.set()
+
+class TestHighLevelReload(TestHighLevel):
+    pvlist = '''
+.* ALLOW
+pv:ban DENY
+'''
+
+    def setUp(self):
+        super(TestHighLevelReload, self).setUp()
+        self._us_provider.add('pv:other', self.pv)
+        self._us_provider.add('pv:ban', self.pv)
+
+    def tearDown(self):
+        super(TestHighLevelReload, self).tearDown()
+        self._pvlistfile.close()
+
+    def test_reload(self):
+        [handler] = self._app.stats.handlers
+        nfiles = len(self._app._args._all_config_files)
+
+        Qname, Qother = Queue(), Queue()
+        with self._ds_client.monitor('pv:name', Qname.put, notify_disconnect=True), \
+             self._ds_client.monitor('pv:other', Qother.put, notify_disconnect=True):
+            for Q in (Qname, Qother):
+                self.assertIsInstance(Q.get(timeout=self.timeout), Disconnected)
+                self.assertEqual(Q.get(timeout=self.timeout), 42)
+
+            # denied, and now banned for this host
+            self.assertRaises(TimeoutError, self._ds_client.get, 'pv:ban', timeout=1.0)
+
+            with handler.channels_lock:
+                [before] = [chan for chans in handler.channels.values() for chan in chans if chan.dsname==b'pv:name']
+
+            created = []
+            orig_create = handler.acf.create
+            def create(chan, *args, **kws):
+                created.append(chan.dsname)
+                return orig_create(chan, *args, **kws)
+            handler.acf.create = create
+            try:
+                self.writePVList('''
+.* ALLOW
+pv:other DENY
+''')
+                self._app.reload()
+            finally:
+                handler.acf.create = orig_create
+
+            # now denied channel is closed
+            self.assertIsInstance(Qother.get(timeout=self.timeout), Disconnected)
+
+            # unaffected channel stays open, and permissions are not re-evaluated
+            self.assertNotIn(b'pv:name', created)
+            self.assertFalse(before.expired)
+            with self.assertRaises(Empty):
+                Qname.get(timeout=0.1)
+            self._ds_client.put('pv:name', 41, timeout=self.timeout)
+            self.assertEqual(Qname.get(timeout=self.timeout), 41)
+
+            # previously banned name is searchable again
+            self.assertEqual(self._ds_client.get('pv:ban', timeout=self.timeout), 41)
+
+        # files are listed once
+        self.assertEqual(len(self._app._args._all_config_files), nfiles)
+
+class TestLoadSource(RefTestCase):
+    timeout = 10
+
+    def setUp(self):
+        super(TestLoadSource, self).setUp()
+        self._server = Server(providers=[StaticProvider('dummy')], isolate=True)
+        self._client = Context('pva', conf=self._server.conf(), useenv=False)
+
+    def tearDown(self):
+        self._client.close()
+        del self._client
+        self._server.stop()
+        del self._server
+        super(TestLoadSource, self).tearDown()
+
+    def test_types(self):
+        _gw.addLoadSource(self._server._S, 'scl:%u', count=3)
+        _gw.addLoadSource(self._server._S, 'wf', type='waveform', size=5)
+        _gw.addLoadSource(self._server._S, 'img', type='ndarray', size=4)
+        _gw.addLoadSource(self._server._S, 'tbl', type='table', size=2)
+
+        V = self._client.get(['scl:0', 'scl:2'], timeout=self.timeout)
+        self.assertEqual(V, [0.0, 0.0])
+
+        V = self._client.get('wf', timeout=self.timeout)
+        self.assertListEqual(list(V), [0.0, 1.0, 2.0, 3.0, 4.0])
+
+        V = self._client.get('img', timeout=self.timeout)
+        self.assertTupleEqual(V.shape, (4, 4))
+
+        V = self._client.get('tbl', timeout=self.timeout)
+        self.assertEqual(len(V), 2)
+
+        with self.assertRaises(TimeoutError):
+            self._client.get('scl:3', timeout=0.1)
+
+    def test_bad_type(self):
+        with self.assertRaises(RuntimeError):
+            _gw.addLoadSource(self._server._S, 'bad', type='invalid')
+
+    def test_echo(self):
+        _gw.addLoadSource(self._server._S, 'echo', echo=True)
+
+        self._client.put('echo', 5.0, timeout=self.timeout)
+        self.assertEqual(self._client.get('echo', timeout=self.timeout), 5.0)
+
+    def test_rate(self):
+        _gw.addLoadSource(self._server._S, 'tick', rate=100.0)
+
+        Q = Queue()
+        sub = self._client.monitor('tick', Q.put)
+        try:
+            A, B = Q.get(timeout=self.timeout), Q.get(timeout=self.timeout)
+            self.assertGreater(B, A)
+        finally:
+            sub.close()
+
+    def test_names(self):
+        def nthreads():
+            return len([ent for ent in threadPlacement() if ent[0]=='LoadSource'])
+        before = nthreads()
+
+        names = ['pv:%d'%i for i in range(1000)] + ['other']
+        _gw.addLoadSource(self._server._S, 'replay', names=names, rate=100.0)
+        _gw.addLoadSource(self._server._S, 'empty', names=[]) # no-op
+
+        # one update thread for all names
+        if before or nthreads(): # thread names not available on all targets
+            self.assertEqual(nthreads(), before+1)
+
+        V = self._client.get(['pv:0', 'pv:999', 'other'], timeout=self.timeout)
+        self.assertEqual(len(V), 3)
+
+        Q = Queue()
+        sub = self._client.monitor('pv:500', Q.put)
+        try:
+            A, B = Q.get(timeout=self.timeout), Q.get(timeout=self.timeout)
+            self.assertGreater(B, A)
+        finally:
+            sub.close()
+
+        with self.assertRaises(TimeoutError):
+            self._client.get('replay', timeout=0.1)
+
 class TestTestServer(RefTestCase):
     conf_template = '''
 {
@@ -691,3 +1258,179 @@ class TestTestServer(RefTestCase):
             main(['-T', conf])
 
         self.assertRegex(self.log(), r".*Unknown command.*ALLW.*")
+
+def findPVAGWD():
+    """Locate the pvagwd executable from a 'make' build, or $PVAGWD.  None if not built.
+    """
+    exe = os.environ.get('PVAGWD')
+    if exe:
+        return exe
+    # <top>/python<ver>/<arch>/p4p  ->  <top>/bin/<arch>/pvagwd
+    pkg = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    arch = os.path.dirname(pkg)
+    exe = os.path.join(os.path.dirname(os.path.dirname(arch)), 'bin', os.path.basename(arch), 'pvagwd')
+    if os.path.isfile(exe):
+        return exe
+
+def freePort(kind):
+    S = socket.socket(socket.AF_INET, kind)
+    try:
+        S.bind(('127.0.0.1', 0))
+        return S.getsockname()[1]
+    finally:
+        S.close()
+
+@unittest.skipIf(findPVAGWD() is None, "pvagwd not built")
+class TestNative(RefTestCase):
+    timeout = 10
+
+    def setUp(self):
+        RefTestCase.setUp(self)
+        self._files = []
+        self._proc = None
+        self._ds_client = None
+        self._us_server = None
+
+    def tearDown(self):
+        if self._ds_client is not None:
+            self._ds_client.close()
+        if self._proc is not None:
+            if self._proc.poll() is None:
+                self._proc.send_signal(signal.SIGINT)
+            self._proc.communicate()
+        if self._us_server is not None:
+            self._us_server.stop()
+        del self._ds_client, self._us_server
+        self.pv = None
+        [f.close() for f in self._files]
+        RefTestCase.tearDown(self)
+
+    def write(self, content):
+        F = NamedTemporaryFile(mode='w+')
+        self._files.append(F)
+        F.write(content)
+        F.flush()
+        return F.name
+
+    def test_pvlist(self):
+        """Native PV list parser agrees with p4p.asLib.pvlist
+        """
+        from .test_asLib import slacPVList, slacPVListCases
+        from ..asLib.pvlist import PVList
+
+        pvl = PVList(slacPVList)
+        fname = self.write(slacPVList)
+
+        P = subprocess.Popen([findPVAGWD(), '-P', fname],
+                             stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                             universal_newlines=True)
+        out, _err = P.communicate(''.join('%s %s\n'%query for query, _expect in slacPVListCases))
+        self.assertEqual(P.returncode, 0)
+
+        actual = []
+        for line in out.splitlines():
+            if line=='DENY':
+                actual.append((None, None, None))
+            else:
+                usname, asg, asl = line.split()
+                actual.append((usname, asg, int(asl)))
+
+        self.assertListEqual(actual, [pvl.compute(pv.encode(), host) for (pv, host), _expect in slacPVListCases])
+        self.assertListEqual(actual, [expect for _query, expect in slacPVListCases])
+
+    def test_pvlist_error(self):
+        P = subprocess.Popen([findPVAGWD(), '-P', self.write('.* ALLW\n')],
+                             stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                             universal_newlines=True)
+        _out, err = P.communicate('')
+        self.assertEqual(P.returncode, 1)
+        self.assertRegex(err, r".*Unknown command.*ALLW.*")
+
+    def startGW(self, pvlist):
+        """Start pvagwd on loopback, in front of an upstream server with 'pv:name' and 'pv:secret'.
+        Returns a client Context connected to the gateway.
+        """
+        self.pv = SharedPV(nt=NTScalar('i'), initial=42)
+        us_provider = StaticProvider('upstream')
+        us_provider.add('pv:name', self.pv)
+        us_provider.add('pv:secret', self.pv)
+
+        self._us_server = Server(providers=[us_provider], isolate=True)
+        us_conf = self._us_server.conf()
+        tcp, udp = freePort(socket.SOCK_STREAM), freePort(socket.SOCK_DGRAM)
+
+        self._pvlist = self.write(pvlist)
+        cfile = self.write(json.dumps({
+            'version':2,
+            'clients':[{
+                'name':'client1',
+                'provider':'pva',
+                'addrlist':'127.0.0.1',
+                'autoaddrlist':False,
+                'bcastport':us_conf['EPICS_PVA_BROADCAST_PORT'],
+                'serverport':0,
+            }],
+            'servers':[{
+                'name':'server1',
+                'clients':['client1'],
+                'interface':['127.0.0.1'],
+                'addrlist':'127.0.0.1',
+                'autoaddrlist':False,
+                'bcastport':udp,
+                'serverport':tcp,
+                'pvlist':self._pvlist,
+            }],
+        }))
+
+        self._proc = subprocess.Popen([findPVAGWD(), cfile])
+
+        self._ds_client = Context('pva', conf={
+            'EPICS_PVA_ADDR_LIST':'127.0.0.1',
+            'EPICS_PVA_AUTO_ADDR_LIST':'NO',
+            'EPICS_PVA_BROADCAST_PORT':str(udp),
+            'EPICS_PVA_SERVER_PORT':str(tcp),
+        }, useenv=False)
+        return self._ds_client
+
+    def stopGW(self):
+        self.assertIsNone(self._proc.poll())
+        self._proc.send_signal(signal.SIGINT)
+        self._proc.communicate()
+        self.assertEqual(self._proc.returncode, 0)
+
+    def test_get(self):
+        """GET through pvagwd
+        """
+        ctxt = self.startGW('''
+.* ALLOW
+pv:secret DENY
+''')
+        self.assertEqual(ctxt.get('pv:name', timeout=self.timeout), 42)
+
+        self.pv.post(43)
+        self.assertEqual(ctxt.get('pv:name', timeout=self.timeout), 43)
+
+        self.assertRaises(TimeoutError, ctxt.get, 'pv:secret', timeout=1.0)
+
+        self.stopGW()
+
+    @unittest.skipIf(not hasattr(signal, 'SIGHUP'), "no SIGHUP")
+    def test_reload(self):
+        """SIGHUP re-reads the pvlist, and forgets the previous search ban
+        """
+        ctxt = self.startGW('''
+.* ALLOW
+pv:secret DENY
+''')
+        self.assertEqual(ctxt.get('pv:name', timeout=self.timeout), 42)
+        # denied, and now banned for this host
+        self.assertRaises(TimeoutError, ctxt.get, 'pv:secret', timeout=1.0)
+
+        with open(self._pvlist, 'w') as F:
+            F.write('.* ALLOW\n')
+        self._proc.send_signal(signal.SIGHUP)
+
+        self.assertEqual(ctxt.get('pv:secret', timeout=self.timeout), 42)
+        self.assertEqual(ctxt.get('pv:name', timeout=self.timeout), 42)
+
+        self.stopGW()
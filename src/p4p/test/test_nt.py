@@ -225,6 +225,23 @@ class TestEnum(RefTestCase):
 
         self.assertEqual(V.value.index, 1)
 
+    def testStoreMany(self):
+        choices = ['c%d'%i for i in range(1000)] + ['c10'] # duplicate
+        V = Value(nt.NTEnum.buildType(), {
+            'value.choices': choices,
+        })
+
+        for i in (999, 0, 10, 500):
+            V.value = 'c%d'%i
+            self.assertEqual(V.value.index, i)
+
+        # different choices, same length
+        V.value.choices = list(reversed(choices))
+        V.value = 'c999'
+        self.assertEqual(V.value.index, 1)
+        V.value = 'c10'
+        self.assertEqual(V.value.index, 0)
+
     def testStoreBad(self):
         V = Value(nt.NTEnum.buildType(), {
             'value.choices': ['zero', 'one', 'two'],
@@ -446,6 +463,44 @@ class TestArray(RefTestCase):
         self.assertEqual(V2.attribute[0].name, u'ColorMode')
         self.assertEqual(V2.attribute[0].value, 2)
 
+    def test_unwrap_view(self):
+        pixels = numpy.arange(24, dtype='u2').reshape((2, 3, 4))
+
+        V = Value(nt.NTNDArray.buildType(), {
+            'value': ('ushortValue', pixels.flatten()),
+            'dimension': [{'size': 4}, {'size': 3}, {'size': 2}],
+        })
+
+        img = nt.NTNDArray.unwrap(V)
+
+        self.assertEqual(img.shape, (2, 3, 4))
+        self.assertEqual(img.strides, pixels.strides)
+        self.assertTrue(img.flags.c_contiguous)
+        self.assertFalse(img.flags.writeable)
+        assert_aequal(img, pixels)
+        self.assertDictEqual(img.attrib, {})
+
+        # shares storage with the Value
+        self.assertEqual(img.ctypes.data, V.value.ctypes.data)
+
+        # round trip without copying pixels
+        V2 = nt.NTNDArray().wrap(img, attrib={'ColorMode':0})
+        self.assertEqual(V2.value.ctypes.data, V.value.ctypes.data)
+        self.assertEqual([D.size for D in V2.dimension], [4, 3, 2])
+
+        # as does a read-only sub-image, which is a view of the view
+        V3 = nt.NTNDArray().wrap(img[1], attrib={'ColorMode':0})
+        self.assertEqual(V3.value.ctypes.data, img[1].ctypes.data)
+        self.assertEqual([D.size for D in V3.dimension], [4, 3])
+
+        # writable input is copied
+        V4 = nt.NTNDArray().wrap(pixels, attrib={'ColorMode':0})
+        self.assertNotEqual(V4.value.ctypes.data, pixels.ctypes.data)
+        assert_aequal(V4.value, pixels.flatten())
+
+        V.dimension[2].size = 3
+        self.assertRaises(ValueError, nt.NTNDArray.unwrap, V)
+
     def testAssign(self):
         V = nt.NTNDArray.buildType()()
         pixels = numpy.asarray([  # 2x3
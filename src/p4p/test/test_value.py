@@ -1,5 +1,6 @@
 
 import weakref
+import itertools
 import gc
 import unittest
 from collections import OrderedDict
@@ -7,7 +8,7 @@ from collections import OrderedDict
 import numpy as np
 from numpy.testing import assert_array_almost_equal as assert_aequal
 
-from ..wrapper import Type, Value
+from ..wrapper import Type, Value, FieldRef, stackValues
 from .. import pvdVersion
 from .utils import RefTestCase
 
@@ -196,6 +197,225 @@ class TestRawValue(RefTestCase):
         V.ival = np.asarray([4, 5], dtype='u8')
         assert_aequal(V.ival, np.asarray([4, 5]))
 
+    def testArrayShare(self):
+        T = Type([('dval', 'ad')])
+
+        # writable arrays are copied
+        A = np.arange(4, dtype=np.float64)
+        V = Value(T, {'dval':A})
+        A[0] = 42
+        assert_aequal(V.dval, [0, 1, 2, 3])
+
+        # read-only view of a writable buffer is copied
+        B = A[:]
+        B.flags.writeable = False
+        V.dval = B
+        A[1] = 43
+        assert_aequal(V.dval, [42, 1, 2, 3])
+        self.assertNotEqual(V.dval.ctypes.data, A.ctypes.data)
+
+        # as are read-only arrays owning their buffer, which may be made writable again
+        A.flags.writeable = False
+        V.dval = A
+        assert_aequal(V.dval, [42, 43, 2, 3])
+        self.assertNotEqual(V.dval.ctypes.data, A.ctypes.data)
+        A.flags.writeable = True
+        A[2] = 44
+        assert_aequal(V.dval, [42, 43, 2, 3])
+
+        # arrays backed by bytes, of exactly the element type, are shared
+        D = np.frombuffer(np.arange(2, dtype=np.float64).tobytes(), dtype=np.float64)
+        V2 = Value(T, {'dval':D})
+        self.assertEqual(V2.dval.ctypes.data, D.ctypes.data)
+
+        # including those returned from another Value
+        V2 = Value(T, {'dval':V.dval})
+        self.assertEqual(V2.dval.ctypes.data, V.dval.ctypes.data)
+        V2.dval = V.dval[1:3]
+        assert_aequal(V2.dval, [43, 2])
+        self.assertEqual(V2.dval.ctypes.data, V.dval[1:].ctypes.data)
+
+        # through views of views
+        V2.dval = V.dval[1:].ravel()[:2]
+        self.assertEqual(V2.dval.ctypes.data, V.dval[1:].ctypes.data)
+        V2.dval = D[1:]
+        self.assertEqual(V2.dval.ctypes.data, D[1:].ctypes.data)
+
+        # but not through a writable parent
+        E = np.arange(4, dtype=np.float64)
+        F = E[1:]
+        F.flags.writeable = False
+        V2.dval = F
+        self.assertNotEqual(V2.dval.ctypes.data, F.ctypes.data)
+
+        # other types are converted
+        C = np.arange(3, dtype=np.int32)
+        C.flags.writeable = False
+        V.dval = C
+        assert_aequal(V.dval, [0, 1, 2])
+
+        del A, B, C, D, E, F
+        V.dval = np.zeros(0)
+        del V, V2
+
+    def testFieldRef(self):
+        T = Type([
+            ('value', 'd'),
+            ('alarm', ('S', None, [
+                ('severity', 'i'),
+            ])),
+        ])
+        value, sevr = FieldRef(T, 'value'), FieldRef(T, 'alarm.severity')
+        self.assertEqual(sevr.name, 'alarm.severity')
+
+        Vs = [T({'value':i, 'alarm':{'severity':i%3}}) for i in range(5)]
+        self.assertListEqual([value.get(V) for V in Vs], [0, 1, 2, 3, 4])
+        self.assertListEqual([sevr.get(V) for V in Vs], [0, 1, 2, 0, 1])
+
+        V = Vs[0]
+        V.unmark()
+        sevr.set(V, 2)
+        self.assertEqual(V.alarm.severity, 2)
+        self.assertSetEqual(V.changedSet(), {'alarm.severity'})
+        self.assertIsInstance(FieldRef(T, 'alarm').get(V), Value)
+
+        # Values of another Type are accessed by name
+        T2 = Type([
+            ('alarm', ('S', None, [
+                ('status', 'i'),
+                ('severity', 'i'),
+            ])),
+            ('value', 'd'),
+        ])
+        V2 = T2({'value':5, 'alarm':{'status':1, 'severity':2}})
+        self.assertEqual(value.get(V2), 5)
+        self.assertEqual(sevr.get(V2), 2)
+        sevr.set(V2, 3)
+        self.assertEqual(V2.alarm.severity, 3)
+        self.assertEqual(V2.alarm.status, 1)
+
+        # as are those of a Type with the same structure
+        T3 = Type(T.aspy())
+        self.assertEqual(sevr.get(T3({'alarm':{'severity':1}})), 1)
+
+        self.assertRaises(KeyError, FieldRef, T, 'nonexistent')
+        self.assertRaises(KeyError, value.get, Type([('other', 'd')])())
+        self.assertRaises(TypeError, value.get, None)
+
+    def testDictAssign(self):
+        T = Type([
+            ('value', 'd'),
+            ('alarm', ('S', None, [
+                ('severity', 'i'),
+                ('message', 's'),
+            ])),
+        ])
+
+        for i in range(3):
+            V = T({'value':i, 'alarm.severity':i, 'alarm.message':'x%d'%i})
+            self.assertEqual(V.value, i)
+            self.assertEqual(V.alarm.severity, i)
+            self.assertEqual(V.alarm.message, 'x%d'%i)
+            self.assertSetEqual(V.changedSet(), {'value', 'alarm.severity', 'alarm.message'})
+
+        # one plan for the repeated key set
+        plans = T._assignPlans()
+        self.assertEqual(len(plans), 1)
+        self.assertIsNotNone(plans[('value', 'alarm.severity', 'alarm.message')])
+
+        # nested dict
+        V = T({'value':1, 'alarm':{'severity':3, 'message':'z'}})
+        self.assertEqual((V.value, V.alarm.severity, V.alarm.message), (1, 3, 'z'))
+
+        # key order differs from field order
+        V = T({'alarm.message':'y', 'value':5, 'alarm.severity':2})
+        self.assertEqual((V.value, V.alarm.severity, V.alarm.message), (5, 2, 'y'))
+        self.assertEqual(len(T._assignPlans()), 3)
+
+        # same keys, different layout
+        T2 = Type([
+            ('alarm', ('S', None, [
+                ('message', 's'),
+                ('severity', 'i'),
+            ])),
+            ('value', 'd'),
+        ])
+        V = T2({'alarm.message':'y', 'value':5, 'alarm.severity':2})
+        self.assertEqual((V.value, V.alarm.severity, V.alarm.message), (5, 2, 'y'))
+
+        # overlapping keys are assigned in dict order, and not planned
+        for _i in range(2):
+            self.assertEqual(T({'alarm.severity':1, 'alarm':{'severity':2}}).alarm.severity, 2)
+            self.assertEqual(T({'alarm':{'severity':2}, 'alarm.severity':1}).alarm.severity, 1)
+        self.assertIsNone(T._assignPlans()[('alarm.severity', 'alarm')])
+
+        # failures are not cached
+        for _i in range(2):
+            self.assertRaises(KeyError, T, {'nonexistent':1})
+            self.assertRaises(TypeError, T, {1:1})
+        self.assertNotIn(('nonexistent',), T._assignPlans())
+
+        # bounded
+        T3 = Type([('f%d'%i, 'i') for i in range(5)])
+        for keys in itertools.islice(itertools.permutations(['f%d'%i for i in range(5)]), 100):
+            V = T3({k:int(k[1:]) for k in keys})
+            self.assertListEqual([V['f%d'%i] for i in range(5)], list(range(5)))
+        self.assertLessEqual(len(T3._assignPlans()), 64)
+
+    def testStack(self):
+        T = Type([
+            ('value', 'ad'),
+            ('scalar', 'i'),
+            ('timeStamp', ('S', None, [
+                ('secondsPastEpoch', 'l'),
+                ('nanoseconds', 'i'),
+            ])),
+        ])
+        Vs = [T({'value':np.arange(3)*i, 'scalar':i, 'timeStamp':{'secondsPastEpoch':10+i, 'nanoseconds':5e8}})
+              for i in range(4)]
+        Vs[1].value = [1.0]
+
+        A, TS = stackValues(Vs)
+        self.assertEqual(A.shape, (4, 3))
+        self.assertEqual(A.dtype, np.float64)
+        assert_aequal(A, [[0, 0, 0], [1, 0, 0], [0, 2, 4], [0, 3, 6]])
+        assert_aequal(TS, [10.5, 11.5, 12.5, 13.5])
+
+        A, TS = stackValues(Vs, 'scalar')
+        self.assertEqual(A.dtype, np.int32)
+        assert_aequal(A, [0, 1, 2, 3])
+
+        A, TS = stackValues([Type([('value', 'd')])({'value':1.5})])
+        assert_aequal(A, [1.5])
+        self.assertTrue(np.isnan(TS[0]))
+
+        # empty capture
+        A, TS = stackValues([])
+        self.assertEqual(A.shape, (0,))
+        self.assertEqual(TS.shape, (0,))
+
+        # all empty arrays
+        A, TS = stackValues([T(), T()])
+        self.assertEqual(A.shape, (2, 0))
+
+        self.assertRaises(KeyError, stackValues, Vs, 'nonexistent')
+        self.assertRaises(TypeError, stackValues, Vs, 'timeStamp')
+        self.assertRaises(TypeError, stackValues, Vs+[Type([('value', 'ai')])()])
+        self.assertRaises(TypeError, stackValues, [1])
+
+    def testToDictRepeat(self):
+        # same shape, different names
+        T1 = Type([('a', 'i'), ('s', ('S', None, [('b', 'i')]))])
+        T2 = Type([('x', 'i'), ('s', ('S', None, [('y', 'i')]))])
+
+        for i in range(3):
+            V1, V2 = T1({'a':i, 's':{'b':-i}}), T2({'x':i, 's':{'y':-i}})
+            self.assertDictEqual(V1.todict(), {'a':i, 's':{'b':-i}})
+            self.assertDictEqual(V2.todict(), {'x':i, 's':{'y':-i}})
+            self.assertDictEqual(V1.todict('s'), {'b':-i})
+            self.assertListEqual(V2.tolist('s'), [('y', -i)])
+            self.assertDictEqual(V1.s.todict(), {'b':-i})
+
     def testSubStruct(self):
         V = Value(Type([
             ('ival', 'i'),
@@ -398,6 +618,32 @@ class TestRawValue(RefTestCase):
             V.x = None  # another way to clear
             self.assertIsNone(V.x)
 
+    def testUnionMagic(self):
+        T = Type([
+            ('x', ('U', None, [
+                ('a', 'ai'),
+                ('b', 'ad'),
+                ('c', 'i'),
+                ('d', 's'),
+            ])),
+        ])
+
+        V = T({'x':42})
+        self.assertEqual(V.x, 42)
+
+        V = T({'x':'hello'})
+        self.assertEqual(V.x, u'hello')
+
+        # array of exactly the element type is preferred
+        V = T({'x':np.asarray([1.5, 2.5])})
+        assert_aequal(V.x, [1.5, 2.5])
+        self.assertEqual(V.x.dtype, np.float64)
+
+        # otherwise the first array which can be assigned
+        V = T({'x':np.asarray([1, 2], dtype='u2')})
+        assert_aequal(V.x, [1, 2])
+        self.assertEqual(V.x.dtype, np.int32)
+
     def testUnionArray(self):
         V = Value(Type([
             ('x', 'av'),
@@ -486,6 +732,48 @@ class TestRawValue(RefTestCase):
         self.assertEqual(len(V.a), 1)
         self.assertEqual(V.a[0].b, 1)
 
+    def testStructArrColumns(self):
+        V = Value(Type([
+            ('a', ('aS', None, [
+                ('b', 'i'),
+                ('c', 'd'),
+                ('d', 's'),
+            ])),
+            ('x', ('aS', None, [
+                ('y', ('S', None, [])),
+            ])),
+        ]), {
+            'a': {
+                'b': [1, 2, 3],
+                'c': np.asarray([1.5, 2.5, 3.5]),
+                'd': ['x', u'y', 'z'],
+            },
+        })
+
+        self.assertEqual(len(V.a), 3)
+        self.assertEqual(V.a[1].b, 2)
+        self.assertEqual(V.a[1].c, 2.5)
+        self.assertEqual(V.a[1].d, u'y')
+
+        C = V.tocolumns('a')
+        self.assertSetEqual(set(C), {'b', 'c', 'd'})
+        self.assertEqual(C['b'].dtype, np.int32)
+        assert_aequal(C['b'], [1, 2, 3])
+        assert_aequal(C['c'], [1.5, 2.5, 3.5])
+        self.assertListEqual(C['d'], [u'x', u'y', u'z'])
+
+        # omitted columns are default, from a numpy structured array
+        V.a = np.asarray([(4, 0.5), (5, 0.25)], dtype=[('b', 'i4'), ('c', 'f8')])
+        C = V.tocolumns('a')
+        assert_aequal(C['b'], [4, 5])
+        assert_aequal(C['c'], [0.5, 0.25])
+        self.assertListEqual(C['d'], [u'', u''])
+
+        self.assertRaises(ValueError, setattr, V, 'a', {'b':[1, 2], 'c':[1.0]})
+        self.assertRaises(KeyError, setattr, V, 'a', {'nonexistent':[1]})
+        self.assertRaises(TypeError, V.tocolumns, 'x')
+        self.assertRaises(TypeError, V.tocolumns)
+
     def testBitSet(self):
         A = Value(Type([
             ('x', 'i'),
@@ -564,6 +852,37 @@ class TestRawValue(RefTestCase):
         self.assertFalse(Z.changed('a'))
         self.assertTrue(Z.changed('b'))
 
+    def testToDictChanged(self):
+        A = Value(Type([
+            ('x', 'i'),
+            ('y', 'i'),
+            ('z', ('S', None, [
+                ('a', 'i'),
+                ('b', 'i'),
+            ])),
+        ]), {
+            'x': 1, 'y': 2, 'z': {'a': 3, 'b': 4},
+        })
+
+        A.unmark()
+        self.assertDictEqual(A.todict(changed_only=True), {})
+
+        A.mark('y')
+        A.mark('z.a')
+        self.assertDictEqual(A.todict(changed_only=True), {'y': 2, 'z': {'a': 3}})
+        self.assertDictEqual(A.todict('z', changed_only=True), {'a': 3})
+        self.assertListEqual(list(A.todict(None, OrderedDict, changed_only=True).items()),
+                             [('y', 2), ('z', OrderedDict([('a', 3)]))])
+
+        A.mark('z')
+        self.assertDictEqual(A.todict(changed_only=True), {'y': 2, 'z': {'a': 3, 'b': 4}})
+
+        A.mark()
+        self.assertDictEqual(A.todict(changed_only=True), A.todict())
+        self.assertDictEqual(A.todict('z', changed_only=True), {'a': 3, 'b': 4})
+
+        self.assertRaises(TypeError, A.todict, 'x', changed_only=True)
+
     def testBitSetSubStruct(self):
         A = Value(Type([
             ('x', 'i'),
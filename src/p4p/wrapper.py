@@ -7,6 +7,8 @@ from . import _p4p
 __all__ = (
     'Type',
     'Value',
+    'FieldRef',
+    'stackValues',
     'Struct',
     'StructArray',
     'Union',
@@ -226,3 +228,6 @@ class Value(_p4p._Value):
         return 'Value(%s)'%', '.join(parts)
 
 _p4p.Value = Value
+
+FieldRef = _p4p.FieldRef
+stackValues = _p4p.stackValues
@@ -0,0 +1,1163 @@
+/* Native PVA gateway daemon.
+ *
+ * Runs GWSource with decisions made in C++ instead of by p4p.gw.GWHandler,
+ * for sites which do not need python customization.
+ * Reads the same JSON configuration, pvlist, and ACF files as p4p.gw,
+ * with some limitations.  cf. documentation/gw.rst
+ *
+ *   pvagwd [-v] [-T] <config.json>
+ */
+
+#ifndef PVXS_ENABLE_EXPERT_API
+#  define PVXS_ENABLE_EXPERT_API
+#endif
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <tuple>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <regex>
+#include <cmath>
+#include <cstdlib>
+#include <csignal>
+#include <cstring>
+
+#include <epicsGetopt.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
+#include <osiSock.h>
+#include <asLib.h>
+#include <yajl_parse.h>
+
+#include <pvxs/log.h>
+#include <pvxs/util.h>
+
+#include "pvxs_gw.h"
+
+DEFINE_LOGGER(_log, "p4p.gwd");
+DEFINE_LOGGER(_logaudit, "p4p.gw.audit");
+
+namespace p4p {
+namespace {
+
+/******* JSON *******/
+
+struct JValue {
+    enum type_t {
+        Null,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object,
+    } type = Null;
+    bool b = false;
+    double num = 0.0;
+    std::string str;
+    std::vector<JValue> arr;
+    std::vector<std::pair<std::string, JValue>> obj; // in file order
+
+    const JValue* find(const std::string& key) const {
+        for(auto& pair : obj) {
+            if(pair.first==key)
+                return &pair.second;
+        }
+        return nullptr;
+    }
+
+    std::string getString(const std::string& key, const std::string& def=std::string()) const {
+        auto val(find(key));
+        if(!val || val->type==Null)
+            return def;
+        if(val->type!=String)
+            throw std::runtime_error(SB()<<"'"<<key<<"' must be a string");
+        return val->str;
+    }
+    double getNumber(const std::string& key, double def) const {
+        auto val(find(key));
+        if(!val || val->type==Null)
+            return def;
+        if(val->type!=Number)
+            throw std::runtime_error(SB()<<"'"<<key<<"' must be a number");
+        return val->num;
+    }
+    bool getBool(const std::string& key, bool def) const {
+        auto val(find(key));
+        if(!val || val->type==Null)
+            return def;
+        if(val->type!=Bool)
+            throw std::runtime_error(SB()<<"'"<<key<<"' must be true or false");
+        return val->b;
+    }
+    // string, or list of strings
+    std::vector<std::string> getStrings(const std::string& key) const {
+        std::vector<std::string> ret;
+        auto val(find(key));
+        if(!val || val->type==Null) {
+        } else if(val->type==String) {
+            ret.push_back(val->str);
+        } else if(val->type==Array) {
+            for(auto& ent : val->arr) {
+                if(ent.type!=String)
+                    throw std::runtime_error(SB()<<"'"<<key<<"' must be a list of strings");
+                ret.push_back(ent.str);
+            }
+        } else {
+            throw std::runtime_error(SB()<<"'"<<key<<"' must be a string or list of strings");
+        }
+        return ret;
+    }
+    // scalar value as configuration string
+    std::string asDef() const {
+        switch(type) {
+        case Bool: return b ? "YES" : "NO";
+        case Number: {
+            std::ostringstream strm;
+            strm<<num;
+            return strm.str();
+        }
+        case String: return str;
+        case Array: {
+            std::string ret;
+            for(auto& ent : arr) {
+                if(!ret.empty())
+                    ret += ' ';
+                ret += ent.asDef();
+            }
+            return ret;
+        }
+        default:
+            return std::string();
+        }
+    }
+};
+
+// build tree from yajl events
+struct JBuilder {
+    JValue root;
+    std::vector<JValue*> stack;
+    std::string key;
+
+    // yajl rejects multiple top level values
+    JValue* add(JValue::type_t type) {
+        JValue* ret;
+        if(stack.empty()) {
+            ret = &root;
+        } else if(stack.back()->type==JValue::Array) {
+            stack.back()->arr.emplace_back();
+            ret = &stack.back()->arr.back();
+        } else {
+            stack.back()->obj.emplace_back(key, JValue());
+            ret = &stack.back()->obj.back().second;
+        }
+        ret->type = type;
+        return ret;
+    }
+
+    static JBuilder& self(void *ctx) { return *static_cast<JBuilder*>(ctx); }
+
+    static int jnull(void *ctx) {
+        self(ctx).add(JValue::Null);
+        return 1;
+    }
+    static int jboolean(void *ctx, int val) {
+        self(ctx).add(JValue::Bool)->b = val;
+        return 1;
+    }
+    static int jnumber(void *ctx, const char *val, size_t len) {
+        self(ctx).add(JValue::Number)->num = std::strtod(std::string(val, len).c_str(), nullptr);
+        return 1;
+    }
+    static int jstring(void *ctx, const unsigned char *val, size_t len) {
+        self(ctx).add(JValue::String)->str.assign((const char*)val, len);
+        return 1;
+    }
+    static int jstart_map(void *ctx) {
+        auto& B = self(ctx);
+        B.stack.push_back(B.add(JValue::Object));
+        return 1;
+    }
+    static int jmap_key(void *ctx, const unsigned char *key, size_t len) {
+        self(ctx).key.assign((const char*)key, len);
+        return 1;
+    }
+    static int jstart_array(void *ctx) {
+        auto& B = self(ctx);
+        B.stack.push_back(B.add(JValue::Array));
+        return 1;
+    }
+    static int jend(void *ctx) {
+        self(ctx).stack.pop_back();
+        return 1;
+    }
+};
+
+// JSON, with C style comments, to tree
+JValue jload(const std::string& text)
+{
+    yajl_callbacks cb = {
+        &JBuilder::jnull,
+        &JBuilder::jboolean,
+        nullptr, // integer
+        nullptr, // double
+        &JBuilder::jnumber,
+        &JBuilder::jstring,
+        &JBuilder::jstart_map,
+        &JBuilder::jmap_key,
+        &JBuilder::jend,
+        &JBuilder::jstart_array,
+        &JBuilder::jend,
+    };
+    JBuilder builder;
+
+    auto handle = yajl_alloc(&cb, nullptr, &builder);
+    if(!handle)
+        throw std::bad_alloc();
+    yajl_config(handle, yajl_allow_comments, 1);
+
+    auto input = (const unsigned char*)text.c_str();
+    auto sts = yajl_parse(handle, input, text.size());
+    if(sts==yajl_status_ok)
+        sts = yajl_complete_parse(handle);
+
+    std::string err;
+    if(sts!=yajl_status_ok) {
+        auto msg = yajl_get_error(handle, 1, input, text.size());
+        err = (const char*)msg;
+        yajl_free_error(handle, msg);
+    }
+    yajl_free(handle);
+
+    if(!err.empty())
+        throw std::runtime_error(err);
+    return std::move(builder.root);
+}
+
+// JSON string literal
+std::string jstr(const std::string& s)
+{
+    std::ostringstream strm;
+    strm<<'"';
+    for(auto c : s) {
+        switch(c) {
+        case '"': strm<<"\\\""; break;
+        case '\\': strm<<"\\\\"; break;
+        case '\n': strm<<"\\n"; break;
+        case '\r': strm<<"\\r"; break;
+        case '\t': strm<<"\\t"; break;
+        default:
+            if((unsigned char)c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)c);
+                strm<<buf;
+            } else {
+                strm<<c;
+            }
+        }
+    }
+    strm<<'"';
+    return strm.str();
+}
+
+std::string readFile(const std::string& fname)
+{
+    std::ifstream F(fname.c_str());
+    if(!F.is_open())
+        throw std::runtime_error(SB()<<"Unable to open \""<<fname<<"\"");
+    std::ostringstream strm;
+    strm<<F.rdbuf();
+    return strm.str();
+}
+
+// relative to directory of config file
+std::string relPath(const std::string& config, const std::string& fname)
+{
+    if(fname.empty() || fname[0]=='/')
+        return fname;
+    auto sep(config.rfind('/'));
+    if(sep==std::string::npos)
+        return fname;
+    return config.substr(0, sep+1u)+fname;
+}
+
+// "{server}" and "{client}" substitution, as with str.format() in p4p.gw
+std::string subName(std::string fname, const std::string& server, const std::string& client)
+{
+    for(auto& pair : {std::make_pair(std::string("{server}"), server),
+                      std::make_pair(std::string("{client}"), client)})
+    {
+        size_t pos;
+        while((pos = fname.find(pair.first))!=std::string::npos)
+            fname.replace(pos, pair.first.size(), pair.second);
+    }
+    return fname;
+}
+
+std::string stripPort(const std::string& peer)
+{
+    auto sep(peer.rfind(':'));
+    return sep==std::string::npos ? peer : peer.substr(0, sep);
+}
+
+/******* PVList.  cf. p4p.asLib.pvlist *******/
+
+struct PVList {
+    struct Allow {
+        std::regex re;
+        bool alias;
+        std::string sub; // in std::regex format() syntax
+        std::string asg;
+        int asl;
+    };
+    // highest precedence first
+    std::vector<Allow> allow;
+    std::vector<std::regex> denyAll;
+    std::map<std::string, std::vector<std::regex>> denyFrom; // by host IP
+
+    static
+    std::string resolve(const std::string& host)
+    {
+        in_addr addr;
+        if(hostToIPAddr(host.c_str(), &addr))
+            throw std::runtime_error(SB()<<"Unable to resolve host \""<<host<<"\"");
+        sockaddr_in sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_addr = addr;
+        char buf[32];
+        ipAddrToDottedIP(&sa, buf, sizeof(buf));
+        return buf;
+    }
+
+    // "\N" to "$N".  Literal '$' to "$$"
+    static
+    std::string convertSub(const std::string& sub, unsigned ngroups)
+    {
+        std::string ret;
+        for(size_t i=0u; i<sub.size(); i++) {
+            if(sub[i]=='$') {
+                ret += "$$";
+            } else if(sub[i]=='\\' && i+1u<sub.size() && isdigit((unsigned char)sub[i+1u])) {
+                size_t end = i+1u;
+                while(end<sub.size() && isdigit((unsigned char)sub[end]))
+                    end++;
+                auto grp(std::stoul(sub.substr(i+1u, end-i-1u)));
+                if(grp<1u || grp>ngroups)
+                    throw std::runtime_error(SB()<<"Out of range substitution "<<grp<<".  Must be in [1, "<<ngroups<<"]");
+                ret += '$';
+                ret += sub.substr(i+1u, end-i-1u);
+                i = end-1u;
+            } else {
+                ret += sub[i];
+            }
+        }
+        return ret;
+    }
+
+    explicit PVList(const std::string& text)
+    {
+        std::vector<std::string> lines;
+        {
+            std::istringstream strm(text.empty() ? std::string(".* ALLOW") : text);
+            std::string line;
+            while(std::getline(strm, line))
+                lines.push_back(line);
+        }
+        std::set<std::string> allowed;
+
+        // ALLOW entries are given in order of increasing precedence.
+        // The last match in the file is used.
+        for(size_t n=lines.size(); n; n--) {
+            const auto lineno = n;
+            try {
+                std::istringstream strm(lines[n-1u]);
+                std::vector<std::string> parts;
+                {
+                    std::string part;
+                    while(strm>>part)
+                        parts.push_back(part);
+                }
+                if(parts.empty() || parts[0][0]=='#')
+                    continue;
+
+                if(parts.size()==4u && parts[0]=="EVALUATION" && parts[1]=="ORDER") {
+                    if(parts[2]=="DENY," && parts[3]=="ALLOW") {
+                        log_warn_printf(_log, "Ignoring \"EVALUATION ORDER DENY, ALLOW\".  Only ALLOW, DENY is implemented.%s", "\n");
+                    } else if(parts[2]!="ALLOW," || parts[3]!="DENY") {
+                        throw std::runtime_error("Invalid order");
+                    }
+                    continue;
+                }
+
+                if(parts.size()<2u)
+                    throw std::runtime_error("Missing command");
+
+                const auto& pattern = parts[0];
+                std::string cmd(parts[1]);
+                std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+
+                std::regex re(pattern); // test compile
+
+                if(allowed.find(pattern)!=allowed.end())
+                    continue; // ignore duplicate pattern
+
+                if(cmd=="DENY") {
+                    size_t first = 2u;
+                    if(parts.size()>2u) {
+                        std::string from(parts[2]);
+                        std::transform(from.begin(), from.end(), from.begin(), ::toupper);
+                        if(from=="FROM")
+                            first++;
+                    }
+                    if(first<parts.size()) {
+                        for(auto i=first; i<parts.size(); i++)
+                            denyFrom[resolve(parts[i])].push_back(re);
+                    } else {
+                        denyAll.push_back(re);
+                    }
+
+                } else if(cmd=="ALIAS" || cmd=="ALLOW") {
+                    Allow ent;
+                    ent.alias = cmd=="ALIAS";
+                    size_t i = 2u;
+                    if(ent.alias) {
+                        if(parts.size()<3u)
+                            throw std::runtime_error("ALIAS requires a substitution");
+                        ent.sub = convertSub(parts[i++], re.mark_count());
+                    }
+                    ent.asg = parts.size()>i ? parts[i] : "DEFAULT";
+                    i++;
+                    ent.asl = parts.size()>i ? std::stoi(parts[i]) : 0;
+                    ent.re = std::move(re);
+                    allow.push_back(std::move(ent));
+                    allowed.insert(pattern);
+
+                } else {
+                    throw std::runtime_error(SB()<<"Unknown command: "<<cmd);
+                }
+
+            } catch(std::exception& e) {
+                throw std::runtime_error(SB()<<"Error on line "<<lineno<<": "<<e.what());
+            }
+        }
+    }
+
+    // Returns false if denied.
+    bool compute(const std::string& pv, const std::string& host,
+                 std::string& usname, std::string& asg, int& asl) const
+    {
+        for(auto& re : denyAll) {
+            if(std::regex_match(pv, re))
+                return false;
+        }
+        auto it(denyFrom.find(host));
+        if(it!=denyFrom.end()) {
+            for(auto& re : it->second) {
+                if(std::regex_match(pv, re))
+                    return false;
+            }
+        }
+
+        std::smatch M;
+        for(auto& ent : allow) {
+            if(std::regex_match(pv, M, ent.re)) {
+                usname = ent.alias ? M.format(ent.sub) : pv;
+                asg = ent.asg;
+                asl = ent.asl;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+/******* ACF *******/
+
+// Permissions from the EPICS Base access security library.
+// Which is process wide, so all servers must use the same ACF file.
+struct ACF {
+    struct Perm {
+        bool put;
+        bool uncached;
+        bool trap;
+    };
+
+    // limit on number of memoized permission sets.  cf. p4p.asLib.Engine.maxPerms
+    static constexpr size_t maxPerms = 4096u;
+
+    epicsMutex lock;
+    // guarded by lock
+    std::map<std::tuple<std::string, int, std::string, std::string>, Perm> memo;
+
+    void load(const std::string& fname)
+    {
+        Guard G(lock);
+        // resolve HAG host names, and match by client IP
+        asCheckClientIP = 1;
+        if(asInitFile(fname.c_str(), nullptr))
+            throw std::runtime_error(SB()<<"Error in ACF file \""<<fname<<"\"");
+        memo.clear();
+    }
+
+    Perm evaluate(const std::string& asg, int asl, const std::string& user, const std::string& host)
+    {
+        Guard G(lock);
+
+        if(!asActive) // no ACF.  Allow all, as with p4p.asLib.Engine.defaultACF
+            return Perm{true, true, false};
+
+        auto key(std::make_tuple(asg, asl, user, host));
+        auto it(memo.find(key));
+        if(it!=memo.end())
+            return it->second;
+
+        Perm perm{false, false, false};
+        ASMEMBERPVT member = nullptr;
+        ASCLIENTPVT client = nullptr;
+        // asAddClient() may modify host in place
+        std::vector<char> hostbuf(host.begin(), host.end());
+        hostbuf.push_back('\0');
+
+        if(!asAddMember(&member, asg.c_str())) {
+            if(!asAddClient(&client, member, asl, user.c_str(), hostbuf.data())) {
+                perm.put = asCheckPut(client);
+                perm.trap = static_cast<ASGCLIENT*>(client)->trapMask;
+                asRemoveClient(&client);
+            }
+            asRemoveMember(&member);
+        }
+
+        if(memo.size() >= maxPerms)
+            memo.clear();
+        memo[key] = perm;
+        return perm;
+    }
+};
+
+/******* Policy *******/
+
+struct ServerConf {
+    std::string name;
+    std::string pvlist; // file name
+    bool readOnly = false;
+    double getholdoff = -1.0;
+    double deadband = -1.0;
+    double reldeadband = -1.0;
+};
+
+struct NativePolicy : public GWPolicy
+{
+    const ServerConf conf;
+    ACF& acf;
+
+    struct Tracked {
+        std::weak_ptr<GWChan> chan;
+        std::string dsname, host, account;
+    };
+
+    mutable epicsMutex lock;
+    // guarded by lock
+    std::shared_ptr<const PVList> pvlist;
+    std::vector<Tracked> channels;
+
+    NativePolicy(const ServerConf& conf, const std::shared_ptr<const PVList>& pvlist, ACF& acf)
+        :conf(conf)
+        ,acf(acf)
+        ,pvlist(pvlist)
+    {}
+    virtual ~NativePolicy() {}
+
+    std::shared_ptr<const PVList> current() const {
+        Guard G(lock);
+        return pvlist;
+    }
+
+    virtual GWSearchResult testChannel(GWSource& src, const std::string& dsname, const std::string& peer) override final
+    {
+        std::string usname, asg;
+        int asl;
+        if(!current()->compute(dsname, stripPort(peer), usname, asg, asl))
+            return GWSearchBanHostPV;
+        return src.test(usname);
+    }
+
+    void apply(GWChan& chan, const std::string& asg, int asl, const std::string& account, const std::string& host)
+    {
+        if(!conf.readOnly) { // default is RO
+            auto perm(acf.evaluate(asg, asl, account, host));
+            chan.allow_put = perm.put;
+            chan.allow_rpc = perm.put;
+            chan.allow_uncached = perm.uncached;
+            chan.audit = perm.trap;
+        }
+    }
+
+    virtual std::shared_ptr<GWChan> makeChannel(GWSource& src, std::unique_ptr<server::ChannelControl>* op) override final
+    {
+        std::shared_ptr<GWChan> ret;
+        auto dsname((*op)->name());
+        auto cred((*op)->credentials());
+        auto host(stripPort(cred->peer));
+
+        std::string usname, asg;
+        int asl;
+        if(!current()->compute(dsname, host, usname, asg, asl) || src.test(usname)!=GWSearchClaim)
+            return ret;
+
+        ret = src.connect(dsname, usname, op);
+        if(!ret)
+            return ret;
+
+        apply(*ret, asg, asl, cred->account, host);
+        if(conf.getholdoff>=0.0)
+            ret->us->get_holdoff = conf.getholdoff;
+        if(conf.deadband>=0.0)
+            ret->deadband = conf.deadband;
+        if(conf.reldeadband>=0.0)
+            ret->reldeadband = conf.reldeadband;
+
+        Guard G(lock);
+        channels.push_back(Tracked{ret, dsname, host, cred->account});
+        return ret;
+    }
+
+    virtual void audit(GWSource& src, std::list<std::string>& msgs) override final
+    {
+        for(auto& msg : msgs)
+            log_info_printf(_logaudit, "%s\n", msg.c_str());
+    }
+
+    void sweep()
+    {
+        Guard G(lock);
+        auto end(std::remove_if(channels.begin(), channels.end(), [](const Tracked& ent) {
+            return ent.chan.expired();
+        }));
+        channels.erase(end, channels.end());
+    }
+
+    // re-evaluate existing channels with new pvlist and/or ACF.
+    void reload(const std::shared_ptr<const PVList>& newlist)
+    {
+        std::vector<Tracked> chans;
+        {
+            Guard G(lock);
+            pvlist = newlist;
+            chans = channels;
+        }
+
+        size_t nclose = 0u, nupdate = 0u;
+        for(auto& ent : chans) {
+            auto chan(ent.chan.lock());
+            if(!chan)
+                continue;
+
+            std::string usname, asg;
+            int asl;
+            if(!newlist->compute(ent.dsname, ent.host, usname, asg, asl) || usname!=chan->us->usname) {
+                chan->dschannel->close();
+                nclose++;
+            } else {
+                apply(*chan, asg, asl, ent.account, ent.host);
+                nupdate++;
+            }
+        }
+        log_info_printf(_log, "Reload %s.  %zu of %zu channels updated, %zu closed\n",
+                        conf.name.c_str(), nupdate, chans.size(), nclose);
+    }
+};
+
+/******* channel cache files.  cf. p4p.gw.saveCache() *******/
+
+void saveCache(GWSource& src, const std::string& fname)
+{
+    std::vector<GWCacheEntry> entries;
+    src.cacheSnapshot(entries);
+
+    auto tmp(fname+".tmp");
+    {
+        std::ofstream F(tmp.c_str());
+        if(!F.is_open())
+            throw std::runtime_error(SB()<<"Unable to write \""<<tmp<<"\"");
+        F.precision(17);
+        F<<"{\"version\": 1, \"names\": [";
+        bool first = true;
+        for(auto& ent : entries) {
+            if(!first)
+                F<<", ";
+            first = false;
+            F<<'['<<jstr(ent.usname)<<", "<<ent.lastuse<<']';
+        }
+        F<<"]}";
+        if(!F.good())
+            throw std::runtime_error(SB()<<"Error writing \""<<tmp<<"\"");
+    }
+    if(rename(tmp.c_str(), fname.c_str()))
+        throw std::runtime_error(SB()<<"Unable to replace \""<<fname<<"\"");
+}
+
+void warmCache(GWSource& src, const std::string& fname, size_t count, double timeout)
+{
+    std::vector<std::pair<double, std::string>> saved;
+    try {
+        auto top(jload(readFile(fname)));
+        auto names(top.find("names"));
+        if(!names || names->type!=JValue::Array)
+            throw std::runtime_error("Missing names");
+        for(auto& ent : names->arr) {
+            if(ent.type!=JValue::Array || ent.arr.size()!=2u
+                    || ent.arr[0].type!=JValue::String || ent.arr[1].type!=JValue::Number)
+                throw std::runtime_error("Invalid entry");
+            saved.emplace_back(ent.arr[1].num, ent.arr[0].str);
+        }
+    } catch(std::exception& e) {
+        log_info_printf(_log, "No channel cache to warm from \"%s\" : %s\n", fname.c_str(), e.what());
+        return;
+    }
+
+    std::sort(saved.begin(), saved.end(), std::greater<std::pair<double, std::string>>());
+    std::vector<std::string> names;
+    for(size_t i=0u; i<saved.size() && i<count; i++)
+        names.push_back(saved[i].second);
+
+    auto N(src.warm(names, timeout));
+    log_info_printf(_log, "Warm %zu of %zu channels connected from \"%s\"\n", N, names.size(), fname.c_str());
+}
+
+/******* Application *******/
+
+volatile sig_atomic_t reloadRequested = 0;
+
+void onSIGHUP(int)
+{
+    reloadRequested = 1;
+}
+
+struct Gateway {
+    struct Provider {
+        std::shared_ptr<GWSource> src;
+        std::shared_ptr<NativePolicy> policy;
+        std::string cachefile;
+    };
+
+    std::string config;
+    bool testOnly = false;
+
+    std::map<std::string, client::Context> clients;
+    std::map<std::string, size_t> shards;
+    std::vector<server::Server> servers;
+    std::vector<Provider> providers;
+
+    ACF acf;
+    std::string acfFile;
+
+    std::vector<std::string> allFiles;
+
+    void setup()
+    {
+        allFiles.push_back(config);
+        auto top(jload(readFile(config)));
+        if(top.type!=JValue::Object)
+            throw std::runtime_error("Configuration must be a JSON Object");
+
+        auto jver(top.getNumber("version", 0.0));
+        if(jver!=1.0 && jver!=2.0)
+            log_err_printf(_log, "Warning: config file version %g not in range [1, 2]\n", jver);
+
+        const bool readOnly = top.getBool("readOnly", false);
+
+        if(top.find("statsdb"))
+            log_warn_printf(_log, "Ignoring 'statsdb'.  Status PVs require python p4p.gw%s", "\n");
+        if(top.find("affinity"))
+            log_warn_printf(_log, "Ignoring 'affinity'.  Use eg. taskset to pin the whole process%s", "\n");
+
+        auto jclients(top.find("clients"));
+        if(jclients && jclients->type==JValue::Array) {
+            for(auto& jcli : jclients->arr) {
+                auto name(jcli.getString("name"));
+                if(clients.find(name)!=clients.end() || shards.find(name)!=shards.end())
+                    throw std::runtime_error(SB()<<"Duplicate client name: "<<name);
+
+                std::map<std::string, std::string> defs;
+                defs["EPICS_PVA_ADDR_LIST"] = jcli.getString("addrlist");
+                defs["EPICS_PVA_AUTO_ADDR_LIST"] = jcli.getBool("autoaddrlist", true) ? "YES" : "NO";
+                if(auto val = jcli.find("bcastport"))
+                    defs["EPICS_PVA_BROADCAST_PORT"] = val->asDef();
+                if(auto val = jcli.find("serverport"))
+                    defs["EPICS_PVA_SERVER_PORT"] = val->asDef();
+                for(auto& pair : jcli.obj) { // pass through
+                    if(pair.first.compare(0, 10, "EPICS_PVA_")==0)
+                        defs[pair.first] = pair.second.asDef();
+                }
+
+                auto provider(jcli.getString("provider", "pva"));
+                if(provider!="pva")
+                    throw std::runtime_error(SB()<<"Client "<<name<<" unsupported provider: "<<provider);
+
+                auto nshard(jcli.getNumber("shards", 1.0));
+                if(nshard<1.0)
+                    throw std::runtime_error(SB()<<"Client "<<name<<" shards must be >= 1");
+                shards[name] = size_t(nshard);
+
+                auto conf(client::Config::fromEnv());
+                conf.applyDefs(defs);
+
+                log_info_printf(_log, "Client effective configuration for %s:\n", name.c_str());
+                for(auto& pair : defs)
+                    log_info_printf(_log, "    %s : %s\n", pair.first.c_str(), pair.second.c_str());
+
+                if(!testOnly)
+                    clients[name] = conf.build();
+            }
+        }
+
+        auto jservers(top.find("servers"));
+        if(!jservers || jservers->type!=JValue::Array)
+            throw std::runtime_error("'servers' list required");
+
+        // one ACF for all
+        for(auto& jsrv : jservers->arr) {
+            auto access(jsrv.getString("access"));
+            if(access.empty()) {
+            } else if(acfFile.empty()) {
+                acfFile = relPath(config, access);
+            } else if(acfFile!=relPath(config, access)) {
+                throw std::runtime_error("pvagwd supports only one ACF file, used by all servers");
+            }
+        }
+        if(!acfFile.empty()) {
+            allFiles.push_back(acfFile);
+            acf.load(acfFile);
+        }
+
+        std::set<std::string> names;
+        for(auto& jsrv : jservers->arr) {
+            auto base_name(jsrv.getString("name"));
+
+            for(auto key : {"statusprefix", "acf_client"}) {
+                if(jsrv.find(key))
+                    log_warn_printf(_log, "Server %s ignoring '%s'.  Requires python p4p.gw\n", base_name.c_str(), key);
+            }
+
+            // one server for each interface
+            auto ifaces(jsrv.getStrings("interface"));
+            if(ifaces.empty())
+                ifaces.push_back("0.0.0.0");
+            auto addrlist(jsrv.getString("addrlist"));
+            if(!addrlist.empty() && ifaces.size()>1u) {
+                log_warn_printf(_log, "Server entries for more than one interface must not specify addrlist.%s", "\n");
+                addrlist.clear();
+            }
+
+            ServerConf sconf;
+            sconf.pvlist = relPath(config, jsrv.getString("pvlist"));
+            sconf.readOnly = readOnly;
+            sconf.getholdoff = jsrv.getNumber("getholdoff", -1.0);
+            sconf.deadband = jsrv.getNumber("deadband", -1.0);
+            sconf.reldeadband = jsrv.getNumber("reldeadband", -1.0);
+
+            std::shared_ptr<const PVList> pvlist;
+            if(sconf.pvlist.empty()) {
+                pvlist = std::make_shared<PVList>(std::string());
+            } else {
+                allFiles.push_back(sconf.pvlist);
+                try {
+                    pvlist = std::make_shared<PVList>(readFile(sconf.pvlist));
+                } catch(std::exception& e) {
+                    throw std::runtime_error(SB()<<"In \""<<sconf.pvlist<<"\" : "<<e.what());
+                }
+            }
+
+            for(size_t idx=0u; idx<ifaces.size(); idx++) {
+                std::string name(SB()<<base_name<<'_'<<idx);
+                if(!names.insert(name).second)
+                    throw std::runtime_error(SB()<<"Duplicate server name: "<<name);
+
+                std::map<std::string, std::string> defs;
+                defs["EPICS_PVAS_INTF_ADDR_LIST"] = ifaces[idx];
+                defs["EPICS_PVAS_BEACON_ADDR_LIST"] = addrlist;
+                defs["EPICS_PVAS_AUTO_BEACON_ADDR_LIST"] = jsrv.getBool("autoaddrlist", true) ? "YES" : "NO";
+                defs["EPICS_PVAS_IGNORE_ADDR_LIST"] = jsrv.getString("ignoreaddr");
+                if(auto val = jsrv.find("bcastport"))
+                    defs["EPICS_PVAS_BROADCAST_PORT"] = val->asDef();
+                if(auto val = jsrv.find("serverport"))
+                    defs["EPICS_PVAS_SERVER_PORT"] = val->asDef();
+                for(auto& pair : jsrv.obj) { // pass through
+                    if(pair.first.compare(0, 9, "EPICS_PVA")==0)
+                        defs[pair.first] = pair.second.asDef();
+                }
+
+                server::Config conf;
+                conf.applyDefs(defs);
+
+                sconf.name = name;
+
+                server::Server serv;
+                if(!testOnly)
+                    serv = conf.build();
+
+                for(auto& cname : jsrv.getStrings("clients")) {
+                    auto nshard(shards.find(cname));
+                    if(nshard==shards.end())
+                        throw std::runtime_error(SB()<<"Server "<<name<<" references undefined client "<<cname);
+                    if(testOnly)
+                        continue;
+
+                    Provider prov;
+                    prov.policy = std::make_shared<NativePolicy>(sconf, pvlist, acf);
+                    prov.src = GWSource::build(clients[cname], nshard->second);
+                    prov.src->policy = prov.policy;
+
+                    auto slowpolicy(jsrv.getString("slowpolicy", "squash"));
+                    if(slowpolicy=="disconnect") {
+                        auto limit(jsrv.getNumber("slowlimit", 100.0));
+                        if(limit<1.0)
+                            throw std::runtime_error("disconnect policy requires limit>0");
+                        prov.src->slowLimit = size_t(limit);
+                    } else if(slowpolicy!="squash") {
+                        throw std::runtime_error(SB()<<"Unknown slow consumer policy "<<slowpolicy);
+                    }
+                    prov.src->cacheBudget = size_t(jsrv.getNumber("cachebudget", 0.0)*1024*1024);
+                    prov.src->searchLimit(jsrv.getNumber("searchrate", 0.0), jsrv.getNumber("searchburst", 0.0));
+
+                    auto record(jsrv.getString("record"));
+                    if(!record.empty())
+                        prov.src->record(subName(record, name, cname));
+
+                    auto cachefile(jsrv.getString("cachefile"));
+                    if(!cachefile.empty()) {
+                        // before server startup, so that clients reconnecting find a warm cache
+                        prov.cachefile = relPath(config, subName(cachefile, name, cname));
+                        warmCache(*prov.src, prov.cachefile,
+                                  size_t(jsrv.getNumber("warmcount", 1000.0)),
+                                  jsrv.getNumber("warmtimeout", 5.0));
+                    }
+
+                    serv.addSource(SB()<<"gws."<<name<<'.'<<cname, prov.src, 10);
+                    providers.push_back(prov);
+                }
+
+                if(!testOnly) {
+                    serv.start();
+                    log_info_printf(_log, "Server effective configuration for %s:\n", name.c_str());
+                    for(auto& pair : defs)
+                        log_info_printf(_log, "    %s : %s\n", pair.first.c_str(), pair.second.c_str());
+                    servers.push_back(serv);
+                }
+            }
+        }
+
+        // inform GW clients of GW server GUIDs to be ignored to prevent loops
+        std::vector<ServerGUID> guids;
+        for(auto& serv : servers)
+            guids.push_back(serv.config().guid);
+        for(auto& prov : providers) {
+            for(auto& shard : prov.src->shards)
+                shard->upstream.ignoreServerGUIDs(guids);
+        }
+    }
+
+    void saveCaches()
+    {
+        for(auto& prov : providers) {
+            if(prov.cachefile.empty())
+                continue;
+            try {
+                saveCache(*prov.src, prov.cachefile);
+            } catch(std::exception& e) {
+                log_err_printf(_log, "Error saving channel cache : %s\n", e.what());
+            }
+        }
+    }
+
+    void sweep()
+    {
+        for(auto& prov : providers) {
+            prov.src->sweep();
+            prov.policy->sweep();
+        }
+    }
+
+    // Invalid files are logged and ignored, leaving the previous configuration in effect.
+    void reload()
+    {
+        log_info_printf(_log, "Reloading ACF and pvlist files%s", "\n");
+        try {
+            if(!acfFile.empty())
+                acf.load(acfFile);
+        } catch(std::exception& e) {
+            log_err_printf(_log, "Reload failed.  Previous ACF remains : %s\n", e.what());
+        }
+
+        std::map<std::string, std::shared_ptr<const PVList>> lists;
+        for(auto& prov : providers) {
+            auto& fname = prov.policy->conf.pvlist;
+            try {
+                auto& pvlist = lists[fname];
+                if(!pvlist)
+                    pvlist = std::make_shared<PVList>(fname.empty() ? std::string() : readFile(fname));
+                prov.policy->reload(pvlist);
+                // forget previously denied names, which may now be allowed
+                prov.src->clearBan();
+            } catch(std::exception& e) {
+                log_err_printf(_log, "Reload of \"%s\" failed.  Previous configuration remains : %s\n",
+                               fname.c_str(), e.what());
+            }
+        }
+    }
+
+    void run()
+    {
+        // needs to be longer than twice the longest search interval
+        const double period = 30.0;
+
+        epicsEvent done;
+        SigInt handle([&done]() {
+            done.signal();
+        });
+#ifdef SIGHUP
+        signal(SIGHUP, &onSIGHUP);
+#endif
+
+        log_info_printf(_log, "*** Gateway STARTS now using \"%s\".\n", config.c_str());
+
+        auto last(epicsTime::getCurrent());
+        while(!done.wait(1.0)) {
+            if(reloadRequested) {
+                reloadRequested = 0;
+                reload();
+            }
+
+            auto now(epicsTime::getCurrent());
+            if(now - last >= period) {
+                last = now;
+                // periodic cleanup of channel cache
+                log_debug_printf(_log, "Channel Cache sweep%s", "\n");
+                try {
+                    sweep();
+                    saveCaches();
+                } catch(std::exception& e) {
+                    log_err_printf(_log, "Error during periodic sweep : %s\n", e.what());
+                }
+            }
+        }
+
+        log_info_printf(_log, "*** Gateway STOPS now.%s", "\n");
+        saveCaches();
+        for(auto& serv : servers)
+            serv.stop();
+    }
+};
+
+void usage(const char* argv0)
+{
+    std::cerr<<"Usage: "<<argv0<<" [-h] [-v] [-T] <config.json>\n"
+               "       "<<argv0<<" -P <pvlist>\n"
+               "\n"
+               "Native PVA gateway.  Reads the same configuration as pvagw.\n"
+               "\n"
+               "  -h  Show this message.\n"
+               "  -v  Enable DEBUG logging of p4p.gw*\n"
+               "  -T  Read and validate configuration files, then exit w/o starting a gateway.\n"
+               "      Also prints the names of all configuration files read.\n"
+               "  -P  Evaluate a PV list file for each \"<pvname> <host IP>\" line read from stdin.\n"
+               "      Prints \"<upstream name> <ASG> <ASL>\", or \"DENY\", for each.\n";
+}
+
+// PV list evaluation, without a gateway.  For testing.
+int checkPVList(const std::string& fname)
+{
+    std::unique_ptr<PVList> pvlist;
+    try {
+        pvlist.reset(new PVList(readFile(fname)));
+    } catch(std::exception& e) {
+        log_err_printf(_log, "Error in \"%s\" : %s\n", fname.c_str(), e.what());
+        return 1;
+    }
+
+    std::string line;
+    while(std::getline(std::cin, line)) {
+        std::istringstream strm(line);
+        std::string pv, host;
+        if(!(strm>>pv))
+            continue;
+        strm>>host;
+
+        std::string usname, asg;
+        int asl = 0;
+        if(pvlist->compute(pv, host, usname, asg, asl))
+            std::cout<<usname<<' '<<asg<<' '<<asl<<'\n';
+        else
+            std::cout<<"DENY\n";
+    }
+    std::cout.flush();
+    return 0;
+}
+
+} // namespace
+} // namespace p4p
+
+int main(int argc, char *argv[])
+{
+    using namespace p4p;
+
+    logger_config_env();
+
+    Gateway gw;
+    std::string pvlist;
+    {
+        int opt;
+        while((opt = getopt(argc, argv, "hvTP:")) != -1) {
+            switch(opt) {
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            case 'v':
+                logger_level_set("p4p.gw*", pvxs::Level::Debug);
+                break;
+            case 'T':
+                gw.testOnly = true;
+                break;
+            case 'P':
+                pvlist = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                std::cerr<<"\nUnknown argument: "<<char(opt)<<std::endl;
+                return 1;
+            }
+        }
+        if(!pvlist.empty()) {
+            if(optind!=argc) {
+                usage(argv[0]);
+                return 1;
+            }
+            return checkPVList(pvlist);
+        }
+        if(optind+1!=argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        gw.config = argv[optind];
+    }
+
+    try {
+        gw.setup();
+    } catch(std::exception& e) {
+        log_err_printf(_log, "Error in \"%s\" : %s\n", gw.config.c_str(), e.what());
+        return 1;
+    }
+
+    if(gw.testOnly) {
+        log_info_printf(_log, "Configuration valid%s", "\n");
+        for(auto& fname : gw.allFiles)
+            std::cout<<fname<<"\n";
+        return 0;
+    }
+
+    gw.run();
+    return 0;
+}
@@ -3,6 +3,12 @@
 #  define PVXS_ENABLE_EXPERT_API
 #endif
 
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+
 #include "p4p.h"
 
 #include <pvxs/source.h>
@@ -11,7 +17,6 @@
 #include <pvxs/log.h>
 
 #include "pvxs_gw.h"
-#include "_gw.h"
 
 DEFINE_LOGGER(_log, "p4p.gw");
 DEFINE_LOGGER(_logget, "p4p.gw.get");
@@ -22,29 +27,540 @@ namespace {
 constexpr size_t banHostLimit   = 1000;
 constexpr size_t banPVLimit     = 10000;
 constexpr size_t banHostPVLimit = 100000;
+
+// Approximate number of bytes of field storage referenced by a Value.
+// Array storage shared with other Values is counted in full.
+size_t valueBytes(const pvxs::Value& val)
+{
+    using namespace pvxs;
+
+    size_t ret = 0u;
+    if(!val)
+        return ret;
+
+    switch(val.type().code) {
+    case TypeCode::Struct:
+        for(auto fld : val.ichildren())
+            ret += valueBytes(fld);
+        break;
+    case TypeCode::Union:
+    case TypeCode::Any:
+        ret += sizeof(void*) + valueBytes(val.as<Value>());
+        break;
+    case TypeCode::StructA:
+    case TypeCode::UnionA:
+    case TypeCode::AnyA:
+        for(auto& elem : val.as<shared_array<const Value>>())
+            ret += sizeof(void*) + valueBytes(elem);
+        break;
+    case TypeCode::String:
+        ret += sizeof(std::string) + val.as<std::string>().size();
+        break;
+    case TypeCode::StringA:
+        for(auto& elem : val.as<shared_array<const std::string>>())
+            ret += sizeof(std::string) + elem.size();
+        break;
+    default:
+        if(val.type().isarray()) {
+            auto arr(val.as<shared_array<const void>>());
+            ret += arr.size() * elementSize(arr.original_type());
+        } else {
+            ret += sizeof(double);
+        }
+        break;
+    }
+    return ret;
+}
+
+// pvRequest in "field(...)record[...]" form, for GWRecorder
+std::string requestString(const pvxs::Value& pvRequest)
+{
+    std::ostringstream strm;
+    strm<<"field(";
+    if(auto fields = pvRequest["field"]) {
+        // only leaf fields.  eg. "alarm.severity" but not "alarm"
+        std::vector<std::string> names;
+        for(auto fld : fields.iall())
+            names.push_back(fields.nameOf(fld));
+        std::sort(names.begin(), names.end());
+
+        bool first = true;
+        for(size_t i=0u; i<names.size(); i++) {
+            if(i+1u<names.size() && names[i+1u].compare(0u, names[i].size()+1u, names[i]+'.')==0)
+                continue;
+            if(!first)
+                strm<<',';
+            first = false;
+            strm<<names[i];
+        }
+    }
+    strm<<")record[";
+    if(auto opts = pvRequest["record._options"]) {
+        bool first = true;
+        for(auto opt : opts.ichildren()) {
+            if(!first)
+                strm<<',';
+            first = false;
+            strm<<opts.nameOf(opt)<<'='<<opt.as<std::string>();
+        }
+    }
+    strm<<']';
+    return strm.str();
+}
 }
 
 namespace p4p {
 
-GWSource::GWSource(const client::Context& ctxt)
-    :upstream(ctxt)
+void GWArrayFilter::parse(const Value& pvRequest)
+{
+    std::string slice, decimate;
+    pvRequest["record._options.slice"].as(slice);
+    pvRequest["record._options.decimate"].as(decimate);
+
+    if(slice.empty() && decimate.empty())
+        return;
+
+    if(!slice.empty()) {
+        // "start:incr:end" where any may be omitted
+        int64_t parts[3] = {0, 1, -1};
+        size_t pos = 0u;
+        for(unsigned i=0; i<3u; i++) {
+            auto sep(i<2u ? slice.find(':', pos) : std::string::npos);
+            if(i<2u && sep==std::string::npos)
+                throw std::runtime_error(SB()<<"slice=\""<<slice<<"\" expected \"start:incr:end\"");
+            auto part(slice.substr(pos, sep==std::string::npos ? std::string::npos : sep-pos));
+            pos = sep+1u;
+
+            if(part.empty())
+                continue;
+            char *end = nullptr;
+            parts[i] = strtoll(part.c_str(), &end, 10);
+            if(*end)
+                throw std::runtime_error(SB()<<"slice=\""<<slice<<"\" invalid number \""<<part<<"\"");
+        }
+        start = parts[0];
+        incr = parts[1];
+        end = parts[2];
+        if(incr<=0)
+            throw std::runtime_error(SB()<<"slice=\""<<slice<<"\" increment must be positive");
+    }
+
+    if(decimate.empty() || decimate=="sample") {
+        reduce = Sample;
+    } else if(decimate=="min") {
+        reduce = Min;
+    } else if(decimate=="max") {
+        reduce = Max;
+    } else if(decimate=="mean") {
+        reduce = Mean;
+    } else {
+        throw std::runtime_error(SB()<<"decimate=\""<<decimate<<"\" must be one of min, max, mean, or sample");
+    }
+
+    if(start==0 && incr==1 && end==-1) {
+        key.clear(); // identity
+    } else {
+        key = SB()<<start<<':'<<incr<<':'<<end<<'/'<<int(reduce);
+    }
+}
+
+namespace {
+// first and count of blocks selected by filt from an array of length N
+size_t filterBounds(const GWArrayFilter& filt, int64_t N, int64_t& first, int64_t& last)
+{
+    first = filt.start<0 ? filt.start+N : filt.start;
+    last = filt.end<0 ? filt.end+N : filt.end;
+    first = std::max(first, int64_t(0));
+    last = std::min(last, N-1);
+
+    return last>=first ? size_t((last-first)/filt.incr + 1) : 0u;
+}
+
+template<typename E>
+shared_array<const void> sampleArray(const GWArrayFilter& filt, const shared_array<const void>& varr)
+{
+    auto arr(varr.castTo<const E>());
+    int64_t first, last;
+    size_t count = filterBounds(filt, arr.size(), first, last);
+
+    shared_array<E> ret(count);
+    for(size_t k=0; k<count; k++)
+        ret[k] = arr[first + int64_t(k)*filt.incr];
+
+    return ret.freeze().template castTo<const void>();
+}
+
+template<typename E>
+shared_array<const void> reduceArray(const GWArrayFilter& filt, const shared_array<const void>& varr)
+{
+    if(filt.reduce==GWArrayFilter::Sample)
+        return sampleArray<E>(filt, varr);
+
+    auto arr(varr.castTo<const E>());
+    int64_t first, last;
+    size_t count = filterBounds(filt, arr.size(), first, last);
+
+    shared_array<E> ret(count);
+    for(size_t k=0; k<count; k++) {
+        auto b(arr.begin() + first + int64_t(k)*filt.incr);
+        auto e(arr.begin() + std::min(first + int64_t(k+1u)*filt.incr, last+1));
+
+        switch(filt.reduce) {
+        case GWArrayFilter::Sample: // handled above
+            break;
+        case GWArrayFilter::Min:
+            ret[k] = *std::min_element(b, e);
+            break;
+        case GWArrayFilter::Max:
+            ret[k] = *std::max_element(b, e);
+            break;
+        case GWArrayFilter::Mean:
+            ret[k] = E(std::accumulate(b, e, 0.0)/(e-b));
+            break;
+        }
+    }
+
+    return ret.freeze().template castTo<const void>();
+}
+} // namespace
+
+Value GWArrayFilter::apply(const Value& val) const
+{
+    auto fld(val["value"]);
+    if(empty() || !fld || !fld.isMarked(true, false) || !fld.type().isarray())
+        return val;
+
+    auto varr(fld.as<shared_array<const void>>());
+    shared_array<const void> out;
+
+    switch(varr.original_type()) {
+#define CASE(TYPE, CTYPE) case ArrayType::TYPE: out = reduceArray<CTYPE>(*this, varr); break
+    CASE(Int8, int8_t);
+    CASE(Int16, int16_t);
+    CASE(Int32, int32_t);
+    CASE(Int64, int64_t);
+    CASE(UInt8, uint8_t);
+    CASE(UInt16, uint16_t);
+    CASE(UInt32, uint32_t);
+    CASE(UInt64, uint64_t);
+    CASE(Float32, float);
+    CASE(Float64, double);
+#undef CASE
+    // no arithmetic on these, so only sample
+    case ArrayType::Bool: out = sampleArray<bool>(*this, varr); break;
+    case ArrayType::String: out = sampleArray<std::string>(*this, varr); break;
+    case ArrayType::Value: out = sampleArray<Value>(*this, varr); break;
+    case ArrayType::Null:
+        return val;
+    }
+
+    auto ret(val.clone()); // shares other array storage
+    ret["value"] = out;
+    return ret;
+}
+
+void GWDeadband::parse(const Value& pvRequest, double chanAbs, double chanRel)
+{
+    double reqAbs = 0.0, reqRel = 0.0;
+    pvRequest["record._options.deadband"].as(reqAbs);
+    pvRequest["record._options.reldeadband"].as(reqRel);
+
+    if(!(reqAbs>=0.0) || !(reqRel>=0.0)) // also NaN
+        throw std::runtime_error("deadband and reldeadband must not be negative");
+
+    abs = std::max(reqAbs, chanAbs);
+    rel = std::max(reqRel, chanRel);
+}
+
+namespace {
+template<typename E>
+bool arrayWithin(const shared_array<const void>& vprev, const shared_array<const void>& vnext, double abs, double rel)
+{
+    auto prev(vprev.castTo<const E>());
+    auto next(vnext.castTo<const E>());
+
+    for(size_t i=0, N=prev.size(); i<N; i++) {
+        double p(prev[i]), diff(std::fabs(double(next[i]) - p));
+        if(!(diff <= std::max(abs, rel*std::fabs(p)))) // also NaN
+            return false;
+    }
+    return true;
+}
+} // namespace
+
+// is 'name' the field 'prefix', or one of its sub-fields
+static
+bool isFieldOf(const std::string& name, const char* prefix, size_t plen)
+{
+    return name.compare(0, plen, prefix)==0 && (name.size()==plen || name[plen]=='.');
+}
+
+bool GWSubscriber::suppress(const Value& delta) const
+{
+    if(deadband.empty() || !haveLast)
+        return false;
+
+    // deadband only defined for NTScalar and NTScalarArray
+    if(!delta.idStartsWith("epics:nt/NTScalar:") && !delta.idStartsWith("epics:nt/NTScalarArray:"))
+        return false;
+
+    // only changes to value, timeStamp, and alarm may be suppressed
+    for(auto fld : delta.imarked()) {
+        auto& name(delta.nameOf(fld));
+        if(!isFieldOf(name, "value", 5)
+                && !isFieldOf(name, "timeStamp", 9)
+                && !isFieldOf(name, "alarm", 5))
+            return false;
+    }
+
+    // any change of alarm state is delivered
+    auto sev(delta["alarm.severity"]);
+    if(sev.isMarked(true, false) && sev.as<int32_t>()!=lastSeverity)
+        return false;
+    auto stat(delta["alarm.status"]);
+    if(stat.isMarked(true, false) && stat.as<int32_t>()!=lastStatus)
+        return false;
+    auto msg(delta["alarm.message"]);
+    if(msg.isMarked(true, false) && msg.as<std::string>()!=lastMessage)
+        return false;
+    if(auto alarm = delta["alarm"]) {
+        for(auto fld : alarm.imarked()) {
+            // some other alarm sub-field
+            if(!fld.equalInst(sev) && !fld.equalInst(stat) && !fld.equalInst(msg))
+                return false;
+        }
+    }
+
+    auto val(delta["value"]);
+    if(!val.isMarked(true, false))
+        return true; // only timeStamp, and/or re-sent alarm
+
+    auto type(val.type());
+    if(!type.isarray()) {
+        double next = 0.0;
+        if(!val.as(next))
+            return false; // not numeric
+        double diff(std::fabs(next - lastScalar));
+        return diff <= std::max(deadband.abs, deadband.rel*std::fabs(lastScalar));
+    }
+
+    auto next(val.as<shared_array<const void>>());
+    if(next.size()!=lastArray.size() || next.original_type()!=lastArray.original_type())
+        return false;
+
+    switch(next.original_type()) {
+#define CASE(TYPE, CTYPE) case ArrayType::TYPE: return arrayWithin<CTYPE>(lastArray, next, deadband.abs, deadband.rel)
+    CASE(Int8, int8_t);
+    CASE(Int16, int16_t);
+    CASE(Int32, int32_t);
+    CASE(Int64, int64_t);
+    CASE(UInt8, uint8_t);
+    CASE(UInt16, uint16_t);
+    CASE(UInt32, uint32_t);
+    CASE(UInt64, uint64_t);
+    CASE(Float32, float);
+    CASE(Float64, double);
+#undef CASE
+    default:
+        return false; // not numeric
+    }
+}
+
+void GWSubscriber::sent(const Value& current)
+{
+    haveLast = true;
+    current["alarm.severity"].as(lastSeverity);
+    current["alarm.status"].as(lastStatus);
+    current["alarm.message"].as(lastMessage);
+    auto val(current["value"]);
+    if(val.type().isarray()) {
+        lastArray = val.as<shared_array<const void>>();
+    } else if(val) {
+        val.as(lastScalar);
+    }
+}
+
+namespace {
+// bound on records buffered while the writer falls behind
+constexpr size_t recordBufferLimit = 16u<<20u;
+
+void putRecordStr(std::string& out, const std::string& s)
+{
+    auto len(std::min(s.size(), size_t(0xffff)));
+    out.push_back(char(uint8_t(len)));
+    out.push_back(char(uint8_t(len>>8u)));
+    out.append(s, 0u, len);
+}
+} // namespace
+
+GWRecorder::GWRecorder(const std::string& fname)
+    :start(epicsTime::getCurrent())
+    ,fp(fopen(fname.c_str(), "wb"))
+    ,writer(*this, "GWRec",
+            epicsThreadGetStackSize(epicsThreadStackSmall),
+            epicsThreadPriorityLow)
+{
+    if(!fp)
+        throw std::runtime_error(SB()<<"Unable to open recording file '"<<fname<<"'");
+
+    uint8_t header[12] = {'P', '4', 'P', 'G', 'W', 'R', 'E', 'C'};
+    for(unsigned i=0u; i<4u; i++)
+        header[8u+i] = uint8_t(version>>(8u*i));
+    fwrite(header, sizeof(header), 1u, fp);
+
+    writer.start();
+}
+
+GWRecorder::~GWRecorder()
+{
+    {
+        Guard G(lock);
+        stop = true;
+    }
+    wakeup.trigger();
+    writer.exitWait(); // writes any pending
+    fclose(fp);
+}
+
+void GWRecorder::record(event_t evt, const std::string& peer, const std::string& name, const Value& pvRequest)
+{
+    // format outside of lock
+    auto req(pvRequest ? requestString(pvRequest) : std::string());
+
+    uint64_t usec = uint64_t((epicsTime::getCurrent() - start)*1e6);
+    std::string rec;
+    rec.reserve(9u + 6u + peer.size() + name.size() + req.size());
+    rec.push_back(char(evt));
+    for(unsigned i=0u; i<8u; i++)
+        rec.push_back(char(uint8_t(usec>>(8u*i))));
+    putRecordStr(rec, peer);
+    putRecordStr(rec, name);
+    putRecordStr(rec, req);
+
+    bool wake;
+    {
+        Guard G(lock);
+        if(pending.size() + rec.size() > recordBufferLimit) {
+            nDrop++;
+            return;
+        }
+        wake = pending.empty();
+        pending += rec;
+    }
+    if(wake)
+        wakeup.trigger();
+}
+
+void GWRecorder::run()
+{
+    std::string buf;
+    Guard G(lock);
+    while(true) {
+        if(pending.empty()) {
+            if(stop)
+                break;
+            UnGuard U(G);
+            wakeup.wait();
+            continue;
+        }
+
+        buf.clear();
+        buf.swap(pending);
+        auto drops(nDrop);
+        nDrop = 0u;
+        {
+            UnGuard U(G);
+            if(fwrite(buf.data(), 1u, buf.size(), fp)!=buf.size())
+                log_err_printf(_log, "Error writing recording: %d\n", errno);
+            if(drops)
+                log_warn_printf(_log, "Recording dropped %zu records\n", drops);
+        }
+    }
+}
+
+GWPolicy::~GWPolicy() {}
+
+GWShard::GWShard(size_t index, const client::Context& ctxt)
+    :index(index)
+    ,upstream(ctxt)
     ,workQ(std::make_shared<decltype(workQ)::element_type>())
-    ,workQworker(*this, "GWQ",
-                 epicsThreadGetStackSize(epicsThreadStackBig),
-                 epicsThreadPriorityMedium)
+    ,worker(*this, index ? std::string(SB()<<"GWQ"<<index).c_str() : "GWQ",
+            epicsThreadGetStackSize(epicsThreadStackBig),
+            epicsThreadPriorityMedium)
 {
-    workQworker.start();
+    worker.start();
 }
 
-GWSource::~GWSource() {
+GWShard::~GWShard() {
+    stop();
+}
+
+void GWShard::stop()
+{
     workQ->push(nullptr);
-    workQworker.exitWait();
+    worker.exitWait();
+}
+
+void GWShard::run()
+{
+    while(auto work = workQ->pop()) {
+        if(!work)
+            break; // NULL means stop
+
+        nWork.fetch_add(1u, std::memory_order_relaxed);
+
+        try {
+            work();
+        }catch(std::exception &e) {
+            log_exc_printf(_log, "Unhandled exception from workQ: %s : %s\n",
+                           work.target_type().name(), e.what());
+        }
+    }
+}
+
+GWSource::GWSource(const client::Context& ctxt, size_t nshard)
+    :upstream(ctxt)
+{
+    shards.reserve(std::max(nshard, size_t(1u)));
+    shards.push_back(std::make_shared<GWShard>(0u, ctxt));
+    for(size_t i=1u; i<nshard; i++) {
+        // independent client context, with its own TCP connections and worker
+        shards.push_back(std::make_shared<GWShard>(i, client::Context(ctxt.config())));
+    }
+    workQ = shards[0]->workQ;
+}
+
+GWSource::~GWSource() {
+    // queued work may reference this
+    for(auto& shard : shards)
+        shard->stop();
 }
 
 void GWSource::onSearch(Search &op)
 {
     // on server worker
 
+    size_t admit = size_t(-1);
+    if(searchRate.load()>0.0) {
+        // strip port
+        std::string host(op.source());
+        auto sep(host.rfind(':'));
+        if(sep!=std::string::npos)
+            host.resize(sep);
+
+        admit = searchAdmit(host, std::distance(op.begin(), op.end()));
+        if(!admit) {
+            log_debug_printf(_log, "%p drop search from '%s'\n", this, host.c_str());
+            return;
+        }
+    }
+
+    if(auto rec = std::atomic_load(&recorder)) {
+        std::string peer(op.source());
+        for(auto& chan : op)
+            rec->record(GWRecorder::Search, peer, chan.name());
+    }
+
     Guard G(mutex);
 
     decltype (banHostPV)::value_type pair;
@@ -56,6 +572,11 @@ void GWSource::onSearch(Search &op)
     }
 
     for(auto& chan : op) {
+        if(!admit--) {
+            log_debug_printf(_log, "%p drop remaining search from '%s'\n", this, pair.first.c_str());
+            break;
+        }
+
         pair.second = chan.name();
 
         if(banPV.find(pair.second)!=banPV.end()) {
@@ -70,13 +591,12 @@ void GWSource::onSearch(Search &op)
         }
 
         GWSearchResult result = GWSearchIgnore;
-        {
-            // GWProvider_testChannel() will also lock our mutex, but must unlock first
+        if(policy) {
+            // testChannel() will also lock our mutex, but must unlock first
             // to maintain lock order ordering wrt. GIL.
             UnGuard U(G);
-            PyLock L;
 
-            result = (GWSearchResult)GWProvider_testChannel(handler, chan.name(), op.source());
+            result = policy->testChannel(*this, chan.name(), op.source());
         }
         log_debug_printf(_log, "%p testChannel '%s':'%s' -> %d\n", this, pair.first.c_str(), pair.second.c_str(), result);
 
@@ -101,9 +621,10 @@ void GWSource::onSearch(Search &op)
 
 GWUpstream::GWUpstream(const std::string& usname, GWSource &src)
     :usname(usname)
-    ,upstream(src.upstream)
+    ,shard(src.shards[std::hash<std::string>()(usname) % src.shards.size()])
+    ,upstream(shard->upstream)
     ,src(src)
-    ,workQ(src.workQ)
+    ,workQ(shard->workQ)
     ,connector(upstream.connect(usname)
                .onConnect([this](){
                     log_debug_printf(_log, "%p upstream connect '%s'\n", &this->src, this->usname.c_str());
@@ -164,6 +685,9 @@ void GWChan::onRPC(const std::shared_ptr<GWChan>& pv, std::unique_ptr<server::Ex
 
     std::shared_ptr<server::ExecOp> sop(std::move(op));
 
+    if(auto rec = std::atomic_load(&pv->us->src.recorder))
+        rec->record(GWRecorder::RPC, sop->peerName(), pv->dsname, sop->pvRequest());
+
     bool permit = pv->allow_rpc;
 
     log_debug_printf(_log, "'%s' RPC %s\n", sop->name().c_str(), permit ? "begin" : "DENY");
@@ -229,6 +753,71 @@ void onInfo(const std::shared_ptr<GWChan>& pv, const std::shared_ptr<server::Con
 
 }
 
+static
+void onGetComplete(const std::shared_ptr<GWGet>& get, const std::shared_ptr<GWUpstream>& us, client::Result&& result)
+{
+    // on client worker
+    // 5. upstream provides result
+
+    Value value; // "delta" from this (re)exec
+    std::string msg;
+    try {
+        value = result();
+    }catch(std::exception& e){
+        msg = e.what();
+    }
+
+    decltype (get->ops) ops;
+    decltype (get->refetch) refetch;
+    Value total; // can give every new client the same (copy of) accumulation
+    {
+        Guard G(us->lock);
+        assert(get->state==GWGet::Exec);
+        get->state = GWGet::Idle;
+
+        ops = std::move(get->ops);
+        refetch = std::move(get->refetch);
+
+        if(value) {
+            get->evicted = false;
+            get->prototype.assign(value); // accumulate, sharing array storage
+
+            for(auto& op : ops) {
+                if(!op.second) {
+                    total = get->prototype.clone(); // also shares array storage
+                    break;
+                }
+            }
+        }
+    }
+
+    if(value) {
+        log_debug_printf(_logget, "'%s' GET exec complete\n", us->usname.c_str());
+
+        try {
+            for(auto& op : ops) {
+                if(op.second) { // after first update, send delta
+                    op.first->reply(value);
+
+                } else { // first update to this client.  send accumulated
+                    op.second = true;
+                    op.first->reply(total);
+                }
+            }
+        }catch(std::exception& e){
+            msg = e.what();
+            value = Value();
+        }
+    }
+
+    if(!value) {
+        log_debug_printf(_logget, "'%s' GET exec complete err='%s'\n", us->usname.c_str(), msg.c_str());
+        for(auto& op : ops) {
+            op.first->error(msg);
+        }
+    }
+}
+
 static
 void onGetCached(const std::shared_ptr<GWChan>& pv, const std::shared_ptr<server::ConnectOp>& ctrl)
 {
@@ -237,12 +826,20 @@ void onGetCached(const std::shared_ptr<GWChan>& pv, const std::shared_ptr<server
 
     const auto& us(pv->us);
 
-    // getop and get->upstream are only used within this function (and thread)
-    auto get(us->getop.lock());
+    std::shared_ptr<GWGet> get;
+    {
+        Guard G(us->lock);
+        get = us->getop.lock();
+    }
+    // get->upstream is only used within this function (and thread)
     auto cliop(get ? get->upstream.lock() : nullptr);
 
     if(!get || !cliop) {
-        us->getop = get = std::make_shared<GWGet>();
+        get = std::make_shared<GWGet>();
+        {
+            Guard G(us->lock);
+            us->getop = get;
+        }
         get->upstream = cliop = us->upstream.get(us->usname)
                 .autoExec(false)
                 .syncCancel(false)
@@ -375,49 +972,37 @@ void onGetCached(const std::shared_ptr<GWChan>& pv, const std::shared_ptr<server
 
                     log_debug_printf(_logget, "'%s' GET holdoff expires\n", us->usname.c_str());
 
-                    cliop->reExecGet([get, us](client::Result&& result) {
-                        // on client worker
-                        // 5. upstream provides result
+                    bool evicted;
+                    {
+                        Guard G(us->lock);
+                        evicted = get->evicted;
+                    }
 
+                    if(!evicted) {
+                        cliop->reExecGet([get, us](client::Result&& result) {
+                            onGetComplete(get, us, std::move(result));
+                        });
 
-                        decltype (get->ops) ops;
-                        {
-                            Guard G(us->lock);
-                            assert(get->state==GWGet::Exec);
-                            get->state = GWGet::Idle;
+                    } else {
+                        // accumulated value was discarded, so a delta would be incomplete.
+                        // start over with a new upstream operation.
+                        log_debug_printf(_logget, "'%s' GET re-fetch evicted\n", us->usname.c_str());
 
-                            ops = std::move(get->ops);
-                        }
+                        auto refetch(us->upstream.get(us->usname)
+                                     .syncCancel(false)
+                                     .result([get, us](client::Result&& result) {
+                                         onGetComplete(get, us, std::move(result));
+                                     })
+                                     .exec());
 
-                        try {
-                            auto value(result()); // "delta" from this (re)exec
-                            Value total; // can give every new client the same (copy of) accumulation
-
-                            get->prototype.from(value); // accumulate...
-
-                            log_debug_printf(_logget, "'%s' GET exec complete\n", us->usname.c_str());
-
-                            for(auto& op : ops) {
-                                if(op.second) { // after first update, send delta
-                                    op.first->reply(value);
-
-                                } else { // first update to this client.  send accumulated
-                                    if(!total)
-                                        total = get->prototype.clone();
-
-                                    op.second = true;
-                                    op.first->reply(total);
-                                }
-                            }
-                        }catch(std::exception& e){
-                            log_debug_printf(_logget, "'%s' GET exec complete err='%s'\n", us->usname.c_str(), e.what());
-                            for(auto& op : ops) {
-                                op.first->error(e.what());
-                            }
-                        }
-                    });
+                        Guard G(us->lock);
+                        // no new exec can begin until we return, so completion has already happened if !Exec
+                        if(get->state==GWGet::Exec)
+                            get->refetch = std::move(refetch);
+                    }
 
                     // note time at which upstream GET is issued
+                    Guard G(us->lock);
                     us->lastget = epicsTime::getCurrent();
                     us->firstget = false;
                 });
@@ -575,6 +1160,13 @@ void GWChan::onOp(const std::shared_ptr<GWChan>& pv, std::unique_ptr<server::Con
     std::shared_ptr<server::ConnectOp> ctrl(std::move(sop));
 
     auto pvReq(ctrl->pvRequest());
+
+    if(auto rec = std::atomic_load(&pv->us->src.recorder)) {
+        auto evt = ctrl->op()==server::ConnectOp::Info ? GWRecorder::Info :
+                   ctrl->op()==server::ConnectOp::Put ? GWRecorder::Put : GWRecorder::Get;
+        rec->record(evt, ctrl->peerName(), pv->dsname, pvReq);
+    }
+
     bool docached = true;
     pvReq["record._options.cache"].as(docached);
 
@@ -616,12 +1208,76 @@ void onSubEvent(const std::shared_ptr<GWSubscription>& sub, const std::shared_pt
 
             log_debug_printf(_logmon, "'%s' MONITOR event\n", cli->name().c_str());
 
-            Guard G(us->lock);
-            sub->current.assign(val); // accumulate deltas
-            sub->state = GWSubscription::Running;
+            std::vector<std::pair<std::shared_ptr<server::ChannelControl>, size_t>> slow;
+            {
+                Guard G(us->lock);
+                sub->current.assign(val); // accumulate deltas, sharing array storage
+                sub->state = GWSubscription::Running;
+
+                const size_t limit = us->src.slowLimit.load();
 
-            for(auto& ctrl : sub->controls)
-                ctrl->post(val); // dispatch() under lock is safe
+                // filtered values for this update, computed once and shared between
+                // subscribers with the same filter.  (filter key, value)
+                std::vector<std::pair<const std::string*, Value>> filtered;
+
+                for(auto& ds : sub->controls) {
+                    if(ds.suppress(val)) {
+                        ds.stale = true;
+                        continue;
+                    }
+
+                    bool squash = false;
+                    if(ds.full) {
+                        // previous post() filled the queue.  Has the client caught up since?
+                        server::MonitorStat stat;
+                        ds.ctrl->stats(stat);
+                        squash = stat.nQueue >= stat.limitQueue;
+                    }
+
+                    if(squash) {
+                        ds.nSquash++;
+                        ds.nOverflow++;
+                    } else {
+                        ds.nOverflow = 0u;
+                    }
+
+                    if(ds.stale) {
+                        // deltas were suppressed, so send everything
+                        ds.full = !ds.ctrl->post(ds.filter.apply(sub->current.clone()));
+                        ds.stale = false;
+
+                    } else if(ds.filter.empty()) {
+                        ds.full = !ds.ctrl->post(val); // dispatch() under lock is safe
+
+                    } else {
+                        auto it(std::find_if(filtered.begin(), filtered.end(),
+                                             [&ds](const std::pair<const std::string*, Value>& ent) {
+                            return *ent.first==ds.filter.key;
+                        }));
+                        if(it==filtered.end()) {
+                            filtered.emplace_back(&ds.filter.key, ds.filter.apply(val));
+                            it = filtered.end()-1;
+                        }
+                        ds.full = !ds.ctrl->post(it->second);
+                    }
+
+                    if(!ds.deadband.empty())
+                        ds.sent(sub->current);
+
+                    if(limit && ds.nOverflow >= limit) {
+                        if(auto chan = ds.dschannel.lock())
+                            slow.emplace_back(std::move(chan), ds.nOverflow);
+                        ds.nOverflow = 0u;
+                    }
+                }
+            }
+
+            // unlock to call() into server worker.
+            for(auto& pair : slow) {
+                log_warn_printf(_logmon, "'%s' MONITOR disconnect slow client %s after %zu squashed updates\n",
+                                pair.first->name().c_str(), pair.first->peerName().c_str(), pair.second);
+                pair.first->close();
+            }
 
          } catch(client::Finished&) {
             log_debug_printf(_logmon, "'%s' MONITOR finish\n", cli->name().c_str());
@@ -635,10 +1291,10 @@ void onSubEvent(const std::shared_ptr<GWSubscription>& sub, const std::shared_pt
                 setups = std::move(sub->setups);
                 controls = std::move(sub->controls);
             }
-            for(auto& ctrl : setups)
-                ctrl->error("Shared monitor finished before starting");
-            for(auto& ctrl : controls)
-                ctrl->finish();
+            for(auto& setup : setups)
+                setup.op->error("Shared monitor finished before starting");
+            for(auto& ds : controls)
+                ds.ctrl->finish();
 
          } catch(std::exception& e) {
             log_warn_printf(_logmon, "'%s' MONITOR error: %s\n",
@@ -659,6 +1315,10 @@ void GWChan::onSubscribe(const std::shared_ptr<GWChan>& pv, std::unique_ptr<serv
     std::shared_ptr<server::MonitorSetupOp> op(std::move(sop));
 
     auto pvReq(op->pvRequest());
+
+    if(auto rec = std::atomic_load(&pv->us->src.recorder))
+        rec->record(GWRecorder::Monitor, op->peerName(), pv->dsname, pvReq);
+
     auto docache = true;
     pvReq["record._options.cache"].as(docache);
 
@@ -667,6 +1327,16 @@ void GWChan::onSubscribe(const std::shared_ptr<GWChan>& pv, std::unique_ptr<serv
         return;
     }
 
+    GWArrayFilter filter;
+    GWDeadband deadband;
+    try {
+        filter.parse(pvReq);
+        deadband.parse(pvReq, pv->deadband.load(), pv->reldeadband.load());
+    }catch(std::exception& e){
+        op->error(e.what());
+        return;
+    }
+
     std::shared_ptr<GWSubscription> sub;
     std::shared_ptr<client::Subscription> cli;
     if(docache) {
@@ -714,8 +1384,8 @@ void GWChan::onSubscribe(const std::shared_ptr<GWChan>& pv, std::unique_ptr<serv
                             trash = std::move(pv->us->subscription);
                             setups = std::move(sub->setups);
                         }
-                        for(auto& op : setups)
-                            op->error(e.what());
+                        for(auto& setup : setups)
+                            setup.op->error(e.what());
                     }
                 })
                         .onInit([sub, pv](client::Subscription& cli, const Value& prototype)
@@ -746,12 +1416,12 @@ void GWChan::onSubscribe(const std::shared_ptr<GWChan>& pv, std::unique_ptr<serv
                     // since we are on the client worker, no further client events are delivered.
                     // however, server events may.  So controls[] may not be empty after re-lock
                     for(auto& setup : setups) {
-                        controls.push_back(setup->connect(sub->current));
+                        controls.emplace_back(setup.op->connect(sub->current), setup.op, setup.dschannel, setup.filter, setup.deadband);
                     }
                     {
                         Guard G(pv->us->lock);
-                        for(auto&& ctrl : controls)
-                            sub->controls.push_back(std::move(ctrl));
+                        for(auto&& ds : controls)
+                            sub->controls.push_back(std::move(ds));
                     }
                 })
                         .exec();
@@ -759,8 +1429,22 @@ void GWChan::onSubscribe(const std::shared_ptr<GWChan>& pv, std::unique_ptr<serv
 
     // tie client subscription lifetime (and by extension GWSubscription) to server op.
     // Reference to CLI stored in internal server OP struct, so no ref. loop
-    op->onClose([cli](const std::string&) {
+    std::weak_ptr<GWSubscription> wsub(sub);
+    std::weak_ptr<server::MonitorSetupOp> wop(op);
+    auto us(pv->us);
+    op->onClose([cli, wsub, wop, us](const std::string&) {
+        // on server worker
         log_debug_printf(_log, "sub close '%s'\n", cli->name().c_str());
+
+        // forget this subscriber.  compare by owner as wop has expired by now.
+        if(auto sub = wsub.lock()) {
+            Guard G(us->lock);
+            auto it(std::remove_if(sub->controls.begin(), sub->controls.end(),
+                                   [&wop](const GWSubscriber& ds) {
+                return !ds.setup.owner_before(wop) && !wop.owner_before(ds.setup);
+            }));
+            sub->controls.erase(it, sub->controls.end());
+        }
     });
 
     {
@@ -776,17 +1460,23 @@ void GWChan::onSubscribe(const std::shared_ptr<GWChan>& pv, std::unique_ptr<serv
         switch(sub->state) {
         case GWSubscription::Connecting:
             log_debug_printf(_logmon, "'%s' MONITOR init conn\n", op->name().c_str());
-            sub->setups.push_back(op);
+            sub->setups.push_back(GWSubscription::Setup{op, pv->dschannel, filter, deadband});
             break;
 
         case GWSubscription::Connected:
         case GWSubscription::Running: {
             log_debug_printf(_logmon, "'%s' MONITOR init run\n", op->name().c_str());
             // post()ing to server worker from server worker will recurse instead of blocking.
-            auto ctrl(op->connect(sub->current));
-            if(sub->state == GWSubscription::Running)
-                ctrl->post(sub->current); // post current as initial for new subscriber
-            sub->controls.emplace_back(std::move(ctrl));
+            sub->controls.emplace_back(op->connect(sub->current), op, pv->dschannel, filter, deadband);
+            auto& ds(sub->controls.back());
+            if(sub->state == GWSubscription::Running) {
+                // post current as initial for new subscriber.
+                // copy as current will be modified by later updates.
+                // array storage remains shared.
+                ds.ctrl->post(filter.apply(sub->current.clone()));
+                if(!deadband.empty())
+                    ds.sent(sub->current);
+            }
             break;
         }
         }
@@ -805,11 +1495,8 @@ void GWSource::onCreate(std::unique_ptr<server::ChannelControl> &&op)
     // to server handles.
 
     std::shared_ptr<GWChan> pv;
-    {
-        PyLock L;
-
-        pv = GWProvider_makeChannel(this, &op);
-    }
+    if(policy)
+        pv = policy->makeChannel(*this, &op);
 
     if(!pv) {
         return; // not our PV.  Let other GWSource s try.
@@ -826,6 +1513,9 @@ void GWSource::onCreate(std::unique_ptr<server::ChannelControl> &&op)
     assert(pv->dschannel);
     auto& ctrl = pv->dschannel;
 
+    if(auto rec = std::atomic_load(&recorder))
+        rec->record(GWRecorder::Create, ctrl->peerName(), pv->dsname);
+
     ctrl->updateInfo(pv->reportInfo);
 
     ctrl->onRPC([pv](std::unique_ptr<server::ExecOp>&& op, Value&& arg) mutable {
@@ -873,6 +1563,7 @@ GWSearchResult GWSource::test(const std::string &usname)
         log_debug_printf(_log, "%p unmark '%s'\n", this, usname.c_str());
         it->second->gcmark = false;
     }
+    it->second->lastuse = epicsTime::getCurrent();
     auto usconn = it->second->connector->connected();
 
     log_debug_printf(_log, "%p test '%s' -> %c\n", this, usname.c_str(), usconn ? '!' : '_');
@@ -892,6 +1583,7 @@ std::shared_ptr<GWChan> GWSource::connect(const std::string& dsname,
 
     auto it(channels.find(usname));
     if(it!=channels.end() && it->second->connector->connected()) {
+        it->second->lastuse = epicsTime::getCurrent();
         std::shared_ptr<server::ChannelControl> op(std::move(*ctrl));
         ret.reset(new GWChan(usname, dsname, it->second, op));
     }
@@ -906,6 +1598,9 @@ void GWSource::sweep()
     // py worker thread
     log_debug_printf(_log, "%p sweeps\n", this);
 
+    // when over budget, skip the mark phase for unused channels
+    const bool over = evict();
+
     std::vector<std::shared_ptr<GWUpstream>> trash;
     // garbage disposal after unlock
 
@@ -918,7 +1613,7 @@ void GWSource::sweep()
             if(cur->second.use_count() > 1u) {
                 // no-op
 
-            } else if(!cur->second->gcmark) {
+            } else if(!cur->second->gcmark && !over) {
                 log_debug_printf(_log, "%p marked '%s'\n", this, cur->first.c_str());
                 cur->second->gcmark = true;
 
@@ -931,7 +1626,215 @@ void GWSource::sweep()
     }
 
     for(auto& tr : trash)
-        upstream.cacheClear(tr->usname);
+        tr->upstream.cacheClear(tr->usname);
+
+    {
+        // forget idle hosts
+        auto now(epicsTime::getCurrent());
+        auto rate(searchRate.load());
+
+        Guard G(searchLock);
+        auto it(searchBuckets.begin()), end(searchBuckets.end());
+        while(it!=end) {
+            auto cur(it++);
+            auto& bucket = cur->second;
+            bool full = bucket.tokens + (now - bucket.last)*rate >= searchBurst;
+            if(full && (!bucket.nDrop || searchBuckets.size() > banHostLimit))
+                searchBuckets.erase(cur);
+        }
+    }
+}
+
+size_t GWSource::searchAdmit(const std::string& host, size_t count)
+{
+    auto rate(searchRate.load());
+    if(rate<=0.0)
+        return count;
+
+    auto now(epicsTime::getCurrent());
+
+    Guard G(searchLock);
+
+    auto it(searchBuckets.find(host));
+    if(it==searchBuckets.end()) {
+        it = searchBuckets.emplace(host, GWSearchBucket()).first;
+        it->second.tokens = searchBurst;
+        it->second.last = now;
+    }
+    auto& bucket = it->second;
+
+    bucket.tokens = std::min(searchBurst, bucket.tokens + (now - bucket.last)*rate);
+    bucket.last = now;
+
+    size_t ret = std::min(count, size_t(bucket.tokens));
+    bucket.tokens -= ret;
+    if(ret < count) {
+        bucket.nDrop += count - ret;
+        nSearchDrop += count - ret;
+    }
+    return ret;
+}
+
+void GWSource::searchLimit(double rate, double burst)
+{
+    if(rate<0.0 || burst<0.0)
+        throw std::runtime_error("Search rate and burst must not be negative");
+
+    Guard G(searchLock);
+    // by default, allow one second worth of searches
+    searchBurst = burst>0.0 ? burst : std::max(1.0, rate);
+    searchRate = rate;
+    if(rate<=0.0)
+        searchBuckets.clear();
+}
+
+void GWSource::searchDrops(std::vector<GWSearchDrop>& drops) const
+{
+    Guard G(searchLock);
+    drops.reserve(searchBuckets.size());
+    for(auto& pair : searchBuckets) {
+        if(pair.second.nDrop)
+            drops.push_back(GWSearchDrop{pair.first, pair.second.nDrop});
+    }
+}
+
+bool GWSource::evict()
+{
+    const size_t budget = cacheBudget.load();
+    if(!budget)
+        return false;
+
+    struct Entry {
+        std::shared_ptr<GWGet> get;
+        GWUpstream* us;
+        epicsTime lastget;
+        size_t bytes;
+    };
+    std::vector<Entry> gets;
+    size_t total = 0u;
+
+    std::vector<std::shared_ptr<GWUpstream>> chans;
+    {
+        Guard G(mutex);
+        chans.reserve(channels.size());
+        for(const auto& pair : channels) {
+            chans.push_back(pair.second);
+        }
+    }
+
+    for(const auto& us : chans) {
+        // one ref. each from channels and chans
+        const bool unused = us.use_count() <= 2u;
+
+        Guard G(us->lock);
+
+        size_t subBytes = 0u, getBytes = 0u;
+        if(auto sub = us->subscription.lock())
+            subBytes = valueBytes(sub->current);
+        auto get(us->getop.lock());
+        if(get && !get->evicted) // evicted retains only an empty structure
+            getBytes = valueBytes(get->prototype);
+
+        if(unused) {
+            // will be swept
+
+        } else {
+            // Active subscriptions are counted, but not evicted.  'current' is the initial
+            // value for the next subscriber, and later deltas are merged into it.
+            total += subBytes + getBytes;
+            if(get && get->state==GWGet::Idle && !get->evicted && getBytes)
+                gets.push_back(Entry{get, us.get(), us->lastget, getBytes});
+        }
+    }
+
+    if(total <= budget)
+        return false;
+
+    log_debug_printf(_log, "%p cache %zu over budget %zu\n", this, total, budget);
+
+    // least recently used first
+    std::sort(gets.begin(), gets.end(), [](const Entry& lhs, const Entry& rhs) {
+        return lhs.lastget < rhs.lastget;
+    });
+
+    for(auto& ent : gets) {
+        if(total <= budget)
+            break;
+
+        Guard G(ent.us->lock);
+        if(ent.get->state!=GWGet::Idle)
+            continue; // raced with exec
+
+        log_debug_printf(_log, "%p evict GET '%s' %zu bytes\n", this, ent.us->usname.c_str(), ent.bytes);
+
+        ent.get->prototype = ent.get->prototype.cloneEmpty();
+        ent.get->evicted = true;
+        total -= ent.bytes;
+    }
+
+    return true;
+}
+
+void GWSource::cacheStats(GWCacheStats& stats) const
+{
+    std::vector<std::shared_ptr<GWUpstream>> chans;
+    {
+        Guard G(mutex);
+        chans.reserve(channels.size());
+        for(const auto& pair : channels) {
+            chans.push_back(pair.second);
+        }
+        stats.ccacheSize = channels.size();
+        stats.banHostSize = banHost.size();
+        stats.banPVSize = banPV.size();
+        stats.banHostPVSize = banHostPV.size();
+    }
+
+    for(const auto& us : chans) {
+        Guard G(us->lock);
+
+        if(auto sub = us->subscription.lock()) {
+            stats.mcacheSize++;
+            stats.mcacheBytes += valueBytes(sub->current);
+        }
+        if(auto get = us->getop.lock()) {
+            stats.gcacheSize++;
+            if(!get->evicted)
+                stats.gcacheBytes += valueBytes(get->prototype);
+        }
+    }
+
+    Guard G(searchLock);
+    stats.searchDrops = nSearchDrop;
+}
+
+void GWSource::shardStats(std::vector<GWShardStats>& stats) const
+{
+    stats.clear();
+    stats.resize(shards.size());
+
+    std::vector<std::shared_ptr<GWUpstream>> chans;
+    {
+        Guard G(mutex);
+        chans.reserve(channels.size());
+        for(const auto& pair : channels) {
+            chans.push_back(pair.second);
+        }
+    }
+
+    for(const auto& us : chans) {
+        auto& stat = stats[us->shard->index];
+        stat.channels++;
+        if(us->connector->connected())
+            stat.connected++;
+
+        Guard G(us->lock);
+        if(us->subscription.lock())
+            stat.subscriptions++;
+    }
+
+    for(size_t i=0u; i<shards.size(); i++)
+        stats[i].work = shards[i]->nWork.load(std::memory_order_relaxed);
 }
 
 void GWSource::forceBan(const std::string& host, const std::string& usname) {
@@ -974,6 +1877,120 @@ void GWSource::cachePeek(std::set<std::string> &names) const {
     }
 }
 
+void GWSource::cached(const std::string& usname, Value& mon, Value& get) const
+{
+    std::shared_ptr<GWUpstream> us;
+    {
+        Guard G(mutex);
+        auto it(channels.find(usname));
+        if(it!=channels.end())
+            us = it->second;
+    }
+    if(!us)
+        return;
+
+    Guard G(us->lock);
+    // copies share array storage with the cache
+    if(auto sub = us->subscription.lock()) {
+        if(sub->current)
+            mon = sub->current.clone();
+    }
+    if(auto op = us->getop.lock()) {
+        if(op->prototype)
+            get = op->prototype.clone();
+    }
+}
+
+void GWSource::record(const std::string& fname)
+{
+    std::shared_ptr<GWRecorder> rec;
+    if(!fname.empty())
+        rec = std::make_shared<GWRecorder>(fname);
+    // previous is closed after any concurrent record() completes
+    std::atomic_store(&recorder, rec);
+    log_info_printf(_log, "%p recording %s\n", this, fname.empty() ? "stopped" : fname.c_str());
+}
+
+void GWSource::cacheSnapshot(std::vector<GWCacheEntry>& entries) const
+{
+    {
+        Guard G(mutex);
+        entries.reserve(channels.size());
+        for(const auto& pair : channels) {
+            epicsTimeStamp ts(pair.second->lastuse);
+            entries.push_back(GWCacheEntry{pair.first, ts.secPastEpoch + POSIX_TIME_AT_EPICS_EPOCH + ts.nsec*1e-9});
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const GWCacheEntry& lhs, const GWCacheEntry& rhs) {
+        return lhs.lastuse > rhs.lastuse;
+    });
+}
+
+size_t GWSource::warm(const std::vector<std::string>& names, double timeout)
+{
+    // creating GWUpstream begins connecting.  All in parallel.
+    for(const auto& name : names)
+        (void)test(name);
+
+    std::vector<std::shared_ptr<GWUpstream>> chans;
+    {
+        Guard G(mutex);
+        chans.reserve(names.size());
+        for(const auto& name : names) {
+            auto it(channels.find(name));
+            if(it!=channels.end())
+                chans.push_back(it->second);
+        }
+    }
+
+    const epicsTime start(epicsTime::getCurrent());
+    size_t nconn;
+    while(true) {
+        nconn = 0u;
+        for(const auto& chan : chans) {
+            if(chan->connector->connected())
+                nconn++;
+        }
+        if(nconn==chans.size() || epicsTime::getCurrent() - start >= timeout)
+            break;
+        epicsThreadSleep(0.1);
+    }
+
+    log_info_printf(_log, "%p warm %zu of %zu channels connected\n", this, nconn, chans.size());
+    return nconn;
+}
+
+void GWSource::slowConsumers(std::vector<GWSlowConsumer>& slow) const
+{
+    std::vector<std::shared_ptr<GWUpstream>> chans;
+    {
+        Guard G(mutex);
+        chans.reserve(channels.size());
+        for(const auto& pair : channels) {
+            chans.push_back(pair.second);
+        }
+    }
+
+    for(const auto& us : chans) {
+        Guard G(us->lock);
+
+        auto sub(us->subscription.lock());
+        if(!sub)
+            continue;
+
+        for(const auto& ds : sub->controls) {
+            if(!ds.full && !ds.nSquash)
+                continue;
+
+            server::MonitorStat stat;
+            ds.ctrl->stats(stat);
+
+            slow.push_back(GWSlowConsumer{us->usname, ds.ctrl->name(), ds.ctrl->peerName(),
+                                          stat.nQueue, stat.limitQueue, ds.nSquash});
+        }
+    }
+}
+
 void GWSource::auditPush(AuditEvent&& revt)
 {
     auto evt(std::move(revt));
@@ -1033,23 +2050,9 @@ void GWSource::auditPush(AuditEvent&& revt)
             msgs.push_back(strm.str());
         }
 
-        GWProvider_audit(this, msgs);
+        if(policy)
+            policy->audit(*this, msgs);
     });
 }
 
-void GWSource::run()
-{
-    while(auto work = workQ->pop()) {
-        if(!work)
-            break; // NULL means stop
-
-        try {
-            work();
-        }catch(std::exception &e) {
-            log_exc_printf(_log, "Unhandled exception from workQ: %s : %s\n",
-                           work.target_type().name(), e.what());
-        }
-    }
-}
-
 } // namespace p4p
@@ -10,6 +10,7 @@
 #include "p4p.h"
 
 #include <epicsThread.h>
+#include <epicsEvent.h>
 
 #include <pvxs/source.h>
 #include <pvxs/sharedpv.h>
@@ -30,6 +31,91 @@ enum GWSearchResult {
     GWSearchBanHostPV,
 };
 
+// Array slicing/decimation requested by a downstream subscriber through
+// pvRequest options record._options.slice="start:incr:end" and
+// record._options.decimate="min", "max", or "mean".
+// Applied to the "value" field.
+struct GWArrayFilter {
+    enum reduce_t {
+        Sample, // first element of each block
+        Min,
+        Max,
+        Mean,
+    } reduce = Sample;
+    // end is inclusive.  negative indices count from the end.
+    int64_t start = 0, incr = 1, end = -1;
+
+    // normalized form of the above.  Equal keys give equal results.
+    // empty when no filter is requested.
+    std::string key;
+
+    // throws std::runtime_error for invalid options
+    void parse(const Value& pvRequest);
+    bool empty() const { return key.empty(); }
+    // returns val, or a copy with filtered "value".
+    Value apply(const Value& val) const;
+};
+
+// Deadband on the "value" field of NTScalar/NTScalarArray.
+// From pvRequest options record._options.deadband and .reldeadband,
+// and GWChan::deadband and GWChan::reldeadband.  The larger is used.
+struct GWDeadband {
+    // changes smaller than or equal to these are not sent
+    double abs = 0.0;
+    double rel = 0.0; // fraction of the last value sent
+
+    // throws std::runtime_error for invalid options
+    void parse(const Value& pvRequest, double chanAbs, double chanRel);
+    bool empty() const { return abs<=0.0 && rel<=0.0; }
+};
+
+// one downstream subscriber of a shared upstream subscription
+struct GWSubscriber {
+    std::shared_ptr<server::MonitorControlOp> ctrl;
+    // identifies the downstream operation, for removal on close.
+    std::weak_ptr<server::MonitorSetupOp> setup;
+    // closed on sustained overflow.  cf. GWSource::slowLimit
+    std::weak_ptr<server::ChannelControl> dschannel;
+
+    // last post() left the queue full
+    bool full = false;
+    // total number of updates squashed into a full queue
+    size_t nSquash = 0u;
+    // number of consecutive updates squashed
+    size_t nOverflow = 0u;
+
+    GWArrayFilter filter;
+
+    GWDeadband deadband;
+    // some updates were suppressed.  next update sends complete value.
+    bool stale = false;
+    // last sent, when deadband active
+    bool haveLast = false;
+    double lastScalar = 0.0;
+    shared_array<const void> lastArray;
+    // alarm last delivered
+    int32_t lastSeverity = 0;
+    int32_t lastStatus = 0;
+    std::string lastMessage;
+
+    GWSubscriber(std::shared_ptr<server::MonitorControlOp>&& ctrl,
+                 const std::weak_ptr<server::MonitorSetupOp>& setup,
+                 const std::weak_ptr<server::ChannelControl>& dschannel,
+                 const GWArrayFilter& filter,
+                 const GWDeadband& deadband)
+        :ctrl(std::move(ctrl))
+        ,setup(setup)
+        ,dschannel(dschannel)
+        ,filter(filter)
+        ,deadband(deadband)
+    {}
+
+    // whether this update does not cross the deadband
+    bool suppress(const Value& delta) const;
+    // note value sent
+    void sent(const Value& current);
+};
+
 struct GWSubscription {
     // should only be lock()'d from server worker
     std::weak_ptr<client::Subscription> upstream;
@@ -42,8 +128,14 @@ struct GWSubscription {
         Running,
     } state = Connecting;
 
-    std::vector<std::shared_ptr<server::MonitorSetupOp>> setups;
-    std::vector<std::shared_ptr<server::MonitorControlOp>> controls;
+    struct Setup {
+        std::shared_ptr<server::MonitorSetupOp> op;
+        std::weak_ptr<server::ChannelControl> dschannel;
+        GWArrayFilter filter;
+        GWDeadband deadband;
+    };
+    std::vector<Setup> setups;
+    std::vector<GWSubscriber> controls;
 };
 
 struct GWGet {
@@ -56,6 +148,10 @@ struct GWGet {
     Value prototype;
     Timer delay;
     std::string error;
+    // accumulated value discarded by GWSource::sweep() to stay within cacheBudget.
+    // next exec re-fetches through a new upstream operation.
+    bool evicted = false;
+    std::shared_ptr<client::Operation> refetch;
 
     enum state_t {  // downstream/server close() at any time...
         Connecting, // waiting for onInit() from upstream/client
@@ -69,21 +165,52 @@ struct GWGet {
     std::vector<std::pair<std::shared_ptr<server::ExecOp>, bool>> ops;
 };
 
+// One upstream client context, with a worker which processes its subscription updates.
+// Upstream channels are spread over GWSource::shards by name.
+struct GWShard : private epicsThreadRunable
+{
+    const size_t index;
+    client::Context upstream;
+
+    const std::shared_ptr<MPMCFIFO<std::function<void()>>> workQ;
+
+    // number of work items processed by worker
+    std::atomic<size_t> nWork{0u};
+
+    epicsThread worker;
+
+    GWShard(size_t index, const client::Context& ctxt);
+    virtual ~GWShard();
+
+    // stop worker.  Queued work is discarded.
+    void stop();
+
+    virtual void run() override final;
+};
+
+struct GWShardStats {
+    size_t channels = 0u;      // upstream channels
+    size_t connected = 0u;     // of which are connected
+    size_t subscriptions = 0u; // shared subscriptions
+    size_t work = 0u;          // cf. GWShard::nWork
+};
+
 struct GWUpstream {
     const std::string usname;
+    const std::shared_ptr<GWShard> shard;
     client::Context upstream; //const after ctor
     GWSource& src;
 
     const std::shared_ptr<MPMCFIFO<std::function<void()>>> workQ;
 
-    // only access from server worker
-    std::weak_ptr<GWGet> getop;
-
     mutable epicsMutex dschans_lock;
     std::set<std::shared_ptr<server::ChannelControl>> dschans;
 
     epicsMutex lock;
 
+    // guarded by lock
+    std::weak_ptr<GWGet> getop;
+
     std::weak_ptr<GWSubscription> subscription;
 
     epicsTime lastget;
@@ -91,6 +218,9 @@ struct GWUpstream {
 
     bool gcmark = false;
 
+    // time of last search or channel creation.  guarded by GWSource::mutex
+    epicsTime lastuse;
+
     // time in msec
     std::atomic<double> get_holdoff{};
 
@@ -121,6 +251,10 @@ struct GWChan {
                       allow_uncached{},
                       audit{};
 
+    // minimum deadband for new subscriptions.  cf. GWDeadband
+    std::atomic<double> deadband{},
+                        reldeadband{};
+
 
     GWChan(const std::string& usname,
            const std::string& dsname,
@@ -144,17 +278,124 @@ struct AuditEvent {
     std::shared_ptr<const server::ClientCredentials> cred;
 };
 
+struct GWSlowConsumer {
+    std::string usname;
+    std::string dsname;
+    std::string peer;
+    size_t nQueue;
+    size_t limitQueue;
+    size_t nSquash;
+};
+
+struct GWCacheEntry {
+    std::string usname;
+    double lastuse; // POSIX time
+};
+
+// token bucket for searches from one client host.  cf. GWSource::searchAdmit()
+struct GWSearchBucket {
+    double tokens = 0.0;
+    epicsTime last;
+    // number of searched names dropped
+    size_t nDrop = 0u;
+};
+
+struct GWSearchDrop {
+    std::string host;
+    size_t nDrop;
+};
+
+struct GWCacheStats {
+    size_t ccacheSize = 0u;  // upstream channels
+    size_t mcacheSize = 0u;  // shared subscriptions
+    size_t gcacheSize = 0u;  // shared GET operations
+    size_t mcacheBytes = 0u; // approximate bytes retained by subscriptions
+    size_t gcacheBytes = 0u; // approximate bytes retained by GET operations
+    size_t banHostSize = 0u;
+    size_t banPVSize = 0u;
+    size_t banHostPVSize = 0u;
+    size_t searchDrops = 0u; // cf. GWSource::nSearchDrop
+};
+
+// Opt-in capture of downstream workload for later replay.  cf. p4p.gwreplay
+//
+// File format, all integers little endian.
+//   header: "P4PGWREC" u32 version
+//   record: u8 event  u64 usec since start  str peer  str name  str request
+//   str:    u16 length  bytes
+// request is in "field(...)record[...]" form.
+//
+// Records are formatted by the caller (eg. a server worker) and buffered.
+// A separate thread writes the buffer to the file.  Records are dropped,
+// and counted, while the buffer is full.
+struct GWRecorder : private epicsThreadRunable {
+    enum event_t : uint8_t {
+        Search = 1,
+        Create = 2,
+        Info = 3,
+        Get = 4,
+        Put = 5,
+        RPC = 6,
+        Monitor = 7,
+    };
+    static constexpr uint32_t version = 1u;
+
+    // throws std::runtime_error if file can not be opened
+    explicit GWRecorder(const std::string& fname);
+    ~GWRecorder();
+
+    void record(event_t evt, const std::string& peer, const std::string& name, const Value& pvRequest=Value());
+
+private:
+    virtual void run() override final;
+
+    const epicsTime start;
+    FILE *fp;
+
+    epicsMutex lock;
+    // guarded by lock
+    std::string pending; // formatted records not yet written
+    size_t nDrop = 0u;
+    bool stop = false;
+
+    epicsEvent wakeup;
+    epicsThread writer;
+};
+
+// Decisions delegated by a GWSource.
+// Python handler object (cf. makePyPolicy()), or native (cf. pvagwd.cpp)
+struct GWPolicy {
+    virtual ~GWPolicy();
+    // Whether to claim a searched for (downstream) name.  Typically calls GWSource::test().
+    // Called without GWSource::mutex
+    virtual GWSearchResult testChannel(GWSource& src, const std::string& dsname, const std::string& peer) =0;
+    // Create channel, or return nullptr to decline.  Typically calls GWSource::connect().
+    virtual std::shared_ptr<GWChan> makeChannel(GWSource& src, std::unique_ptr<server::ChannelControl>* op) =0;
+    // Write out put log messages
+    virtual void audit(GWSource& src, std::list<std::string>& msgs) =0;
+};
+
+// calls methods of GWSource::handler
+std::shared_ptr<GWPolicy> makePyPolicy();
+
 struct GWSource : public server::Source,
-                  public std::enable_shared_from_this<GWSource>,
-                  private epicsThreadRunable
+                  public std::enable_shared_from_this<GWSource>
 {
+    // primary upstream context.  same as shards[0]->upstream
     client::Context upstream;
 
+    // const after ctor
+    std::vector<std::shared_ptr<GWShard>> shards;
+
     mutable epicsMutex mutex;
 
     std::set<std::string> banHost, banPV;
     std::set<std::pair<std::string, std::string>> banHostPV;
 
+    // set before adding to a Server.  const afterwards.
+    std::shared_ptr<GWPolicy> policy;
+
+    // used by makePyPolicy().  guarded by GIL
     PyObject *handler = nullptr;
 
     // channel cache.  Indexed by upstream name
@@ -162,15 +403,36 @@ struct GWSource : public server::Source,
 
     std::list<AuditEvent> audits;
 
-    decltype (GWUpstream::workQ) workQ;
+    // Number of consecutive updates squashed into a full downstream queue
+    // before the downstream channel is closed.  Zero to only squash.
+    std::atomic<size_t> slowLimit{0u};
+
+    // Approximate limit in bytes on values retained by the channel cache,
+    // enforced by sweep().  Zero for no limit.
+    std::atomic<size_t> cacheBudget{0u};
+
+    // Limit on searched names per second from each client host.  Zero for no limit.
+    std::atomic<double> searchRate{0.0};
 
-    epicsThread workQworker;
+    // separate from mutex so that excess searches are dropped cheaply.
+    mutable epicsMutex searchLock;
+    // guarded by searchLock
+    double searchBurst = 0.0;
+    std::map<std::string, GWSearchBucket> searchBuckets; // by host
+    size_t nSearchDrop = 0u;
 
+    // opt-in workload capture.  Use std::atomic_load() and std::atomic_store()
+    std::shared_ptr<GWRecorder> recorder;
+
+    // of shards[0].  also used for audit log
+    std::shared_ptr<decltype (GWShard::workQ)::element_type> workQ; // const after ctor
+
+    // nshard-1 additional upstream contexts are created with the configuration of ctxt
     static
-    std::shared_ptr<GWSource> build(const client::Context& ctxt) {
-        return std::shared_ptr<GWSource>(new GWSource(ctxt));
+    std::shared_ptr<GWSource> build(const client::Context& ctxt, size_t nshard=1u) {
+        return std::shared_ptr<GWSource>(new GWSource(ctxt, nshard));
     }
-    GWSource(const client::Context& ctxt);
+    GWSource(const client::Context& ctxt, size_t nshard);
     virtual ~GWSource();
 
     // for server::Source
@@ -184,14 +446,34 @@ struct GWSource : public server::Source,
                                     std::unique_ptr<server::ChannelControl> *op);
 
     void sweep();
+    // of count names searched for by host, how many to consider.  cf. searchRate
+    size_t searchAdmit(const std::string& host, size_t count);
+    void searchLimit(double rate, double burst);
+    void searchDrops(std::vector<GWSearchDrop>& drops) const;
+    // discard cached GET values, least recently used first, until within cacheBudget.
+    // returns true if over budget.
+    bool evict();
     void forceBan(const std::string& host, const std::string& usname);
     void clearBan();
 
     void cachePeek(std::set<std::string> &names) const;
+    // names in channel cache, most recently used first
+    void cacheSnapshot(std::vector<GWCacheEntry>& entries) const;
+    // copies of the cached subscription and GET values of an upstream PV.  Empty if none.
+    void cached(const std::string& usname, Value& mon, Value& get) const;
+    // Add names to the channel cache, and wait up to timeout seconds for
+    // upstream connections.  Returns the number connected.
+    size_t warm(const std::vector<std::string>& names, double timeout);
 
-    void auditPush(AuditEvent&& evt);
+    void slowConsumers(std::vector<GWSlowConsumer>& slow) const;
 
-    virtual void run() override final;
+    // start capture to file, replacing any previous.  Empty name to stop.
+    void record(const std::string& fname);
+
+    void cacheStats(GWCacheStats& stats) const;
+    void shardStats(std::vector<GWShardStats>& stats) const;
+
+    void auditPush(AuditEvent&& evt);
 };
 
 } // namespace p4p
@@ -0,0 +1,54 @@
+
+#ifndef PVXS_ENABLE_EXPERT_API
+#  define PVXS_ENABLE_EXPERT_API
+#endif
+
+#include "p4p.h"
+
+#include "pvxs_gw.h"
+#include "_gw.h"
+
+// Python half of the gateway.
+// Kept separate so that pvxs_gw.cpp may be used by pvagwd without the Python runtime.
+
+namespace p4p {
+
+namespace {
+
+struct GWPyPolicy : public GWPolicy
+{
+    virtual ~GWPyPolicy() {}
+
+    virtual GWSearchResult testChannel(GWSource& src, const std::string& dsname, const std::string& peer) override final
+    {
+        PyLock L;
+
+        if(!src.handler)
+            return GWSearchIgnore;
+
+        return (GWSearchResult)GWProvider_testChannel(src.handler, dsname.c_str(), peer.c_str());
+    }
+
+    virtual std::shared_ptr<GWChan> makeChannel(GWSource& src, std::unique_ptr<server::ChannelControl>* op) override final
+    {
+        PyLock L;
+
+        return GWProvider_makeChannel(&src, op);
+    }
+
+    virtual void audit(GWSource& src, std::list<std::string>& msgs) override final
+    {
+        PyLock L;
+
+        GWProvider_audit(&src, msgs);
+    }
+};
+
+} // namespace
+
+std::shared_ptr<GWPolicy> makePyPolicy()
+{
+    return std::make_shared<GWPyPolicy>();
+}
+
+} // namespace p4p
@@ -1,18 +1,27 @@
-/* Tool for testing get throttling
+/* Tools for testing
  *
+ * OdometerSource tests get throttling.
  * A server which only handles GET.
  * Each GET is answered from a global counter counter.
+ *
+ * LoadSource generates synthetic load.
+ * Many PVs of a configurable type, updated at a fixed rate.
  */
 
 #include <iostream>
 
 #include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
 
 #include <pvxs/server.h>
 #include <pvxs/source.h>
+#include <pvxs/sharedpv.h>
 #include <pvxs/nt.h>
 #include <pvxs/log.h>
 
+#include "p4p.h"
+
 using namespace pvxs;
 
 namespace {
@@ -60,6 +69,209 @@ struct OdometerSource : public server::Source {
     }
 };
 
+struct LoadSource : public server::Source,
+                    private epicsThreadRunable
+{
+    enum type_t {
+        Scalar,
+        Waveform,
+        NDArray,
+        Table,
+    };
+
+    const p4p::LoadConfig conf;
+    const type_t type;
+    const Value prototype;
+
+    server::StaticSource pvs;
+    const std::shared_ptr<server::Source> inner;
+
+    uint64_t counter = 0u;
+
+    epicsEvent wakeup;
+    bool stop = false; // only set before wakeup.trigger()
+    epicsThread worker;
+
+    static
+    type_t parseType(const std::string& type)
+    {
+        if(type=="scalar")
+            return Scalar;
+        else if(type=="waveform")
+            return Waveform;
+        else if(type=="ndarray")
+            return NDArray;
+        else if(type=="table")
+            return Table;
+        else
+            throw std::runtime_error(p4p::SB()<<"Unknown load type \""<<type<<"\"");
+    }
+
+    static
+    Value build(type_t type)
+    {
+        switch(type) {
+        case Scalar:
+            return nt::NTScalar{TypeCode::Float64}.create();
+        case Waveform:
+            return nt::NTScalar{TypeCode::Float64A}.create();
+        case NDArray:
+            return nt::NTNDArray{}.create();
+        case Table:
+            return nt::NTTable{}
+                    .add_column(TypeCode::UInt64, "index", "Index")
+                    .add_column(TypeCode::Float64, "value", "Value")
+                    .create();
+        }
+        throw std::logic_error("missing case");
+    }
+
+    explicit LoadSource(const p4p::LoadConfig& conf)
+        :conf(conf)
+        ,type(parseType(conf.type))
+        ,prototype(build(type))
+        ,pvs(server::StaticSource::build())
+        ,inner(pvs.source())
+        ,worker(*this, "LoadSource",
+                epicsThreadGetStackSize(epicsThreadStackSmall),
+                epicsThreadPriorityMedium)
+    {
+        if(conf.rate<0.0)
+            throw std::runtime_error("Load rate must not be negative");
+
+        auto initial(next());
+
+        const size_t count = conf.names.empty() ? conf.count : conf.names.size();
+        for(size_t i=0u; i<count; i++) {
+            auto pv(conf.echo ? server::SharedPV::buildMailbox() : server::SharedPV::buildReadonly());
+
+            const bool echo = conf.echo;
+            pv.onRPC([echo](server::SharedPV& pv, std::unique_ptr<server::ExecOp>&& op, Value&& arg) {
+                if(echo)
+                    op->reply(arg);
+                else
+                    op->error("RPC not enabled");
+            });
+
+            pv.open(initial);
+
+            pvs.add(name(i), pv);
+        }
+
+        if(conf.rate>0.0)
+            worker.start();
+    }
+    virtual ~LoadSource()
+    {
+        if(conf.rate>0.0) {
+            stop = true;
+            wakeup.trigger();
+            worker.exitWait();
+        }
+        pvs.close();
+    }
+
+    std::string name(size_t i) const
+    {
+        if(!conf.names.empty())
+            return conf.names[i];
+
+        std::string ret(conf.pattern);
+        auto pos(ret.find("%u"));
+        if(pos!=std::string::npos) {
+            ret.replace(pos, 2u, std::to_string(i));
+        } else if(conf.count>1u) {
+            ret += std::to_string(i);
+        }
+        return ret;
+    }
+
+    // next update, shared by all PVs
+    Value next()
+    {
+        auto val(prototype.cloneEmpty());
+        auto count(counter++);
+
+        epicsTimeStamp now;
+        (void)epicsTimeGetCurrent(&now);
+        val["timeStamp.secondsPastEpoch"] = now.secPastEpoch + POSIX_TIME_AT_EPICS_EPOCH;
+        val["timeStamp.nanoseconds"] = now.nsec;
+
+        switch(type) {
+        case Scalar:
+            val["value"] = double(count);
+            break;
+
+        case Waveform: {
+            shared_array<double> arr(conf.size);
+            for(size_t i=0u; i<arr.size(); i++)
+                arr[i] = double(count + i);
+            val["value"] = arr.freeze();
+        }
+            break;
+
+        case NDArray: {
+            shared_array<uint16_t> arr(conf.size*conf.size);
+            for(size_t i=0u; i<arr.size(); i++)
+                arr[i] = uint16_t(count + i);
+            val["value->ushortValue"] = arr.freeze();
+
+            auto dimfld(val["dimension"]);
+            shared_array<Value> dims(2u);
+            for(auto& dim : dims) {
+                dim = dimfld.allocMember();
+                dim["size"] = conf.size;
+                dim["fullSize"] = conf.size;
+                dim["binning"] = 1;
+            }
+            dimfld = dims.freeze();
+
+            val["uniqueId"] = int32_t(count);
+            val["compressedSize"] = conf.size*conf.size*sizeof(uint16_t);
+            val["uncompressedSize"] = conf.size*conf.size*sizeof(uint16_t);
+            val["dataTimeStamp"].assign(val["timeStamp"]);
+        }
+            break;
+
+        case Table: {
+            shared_array<uint64_t> index(conf.size);
+            shared_array<double> value(conf.size);
+            for(size_t i=0u; i<conf.size; i++) {
+                index[i] = i;
+                value[i] = double(count + i);
+            }
+            val["value.index"] = index.freeze();
+            val["value.value"] = value.freeze();
+        }
+            break;
+        }
+
+        return val;
+    }
+
+    virtual void run() override final
+    {
+        const double period = 1.0/conf.rate;
+        auto pvlist(pvs.list());
+
+        while(true) {
+            wakeup.wait(period);
+            if(stop)
+                break;
+
+            auto val(next());
+            for(auto& pair : pvlist) {
+                pair.second.post(val);
+            }
+        }
+    }
+
+    // for server::Source
+    virtual void onSearch(Search &op) override final { inner->onSearch(op); }
+    virtual void onCreate(std::unique_ptr<server::ChannelControl> &&op) override final { inner->onCreate(std::move(op)); }
+    virtual List onList() override final { return inner->onList(); }
+};
+
 } // namespace
 
 namespace p4p {
@@ -68,4 +280,8 @@ std::shared_ptr<server::Source> makeOdometer(const std::string& name) {
     return std::make_shared<OdometerSource>(name);
 }
 
+std::shared_ptr<server::Source> makeLoadSource(const LoadConfig& conf) {
+    return std::make_shared<LoadSource>(conf);
+}
+
 } // namespace p4p
@@ -1,5 +1,12 @@
 
 #include <sstream>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <set>
+#include <list>
+#include <unordered_map>
+#include <limits>
 
 #include <p4p.h>
 #include <_p4p.h>
@@ -28,6 +35,133 @@ int except_map()
     return 0;
 }
 
+namespace {
+
+// Interned python keys by member name.  Guarded by the GIL.
+// Never free'd as PyRef must not outlive the interpreter.
+std::map<std::string, PyRef>* unpackKeys;
+constexpr size_t maxKeys = 4096u;
+
+PyObject* unpackKey(const std::string& name)
+{
+    if(!unpackKeys)
+        unpackKeys = new std::map<std::string, PyRef>;
+
+    auto it(unpackKeys->find(name));
+    if(it==unpackKeys->end()) {
+        if(unpackKeys->size() >= maxKeys)
+            unpackKeys->clear();
+#if PY_MAJOR_VERSION < 3
+        PyRef key(PyString_InternFromString(name.c_str()));
+#else
+        PyRef key(PyUnicode_InternFromString(name.c_str()));
+#endif
+        it = unpackKeys->emplace(name, std::move(key)).first;
+    }
+    return it->second.obj; // borrowed
+}
+
+PyObject* asPyStruct(const Value& v, bool unpackrecurse, PyObject* wrapper)
+{
+    // build dict() directly, without intermediate list of tuples
+    const bool isdict = wrapper==(PyObject*)&PyDict_Type;
+
+    PyRef mems(isdict ? PyDict_New() : PyList_New(0));
+
+    for(const auto &mem : v.ichildren()) {
+        // recursion may clear unpackKeys
+        auto key(PyRef::borrow(unpackKey(v.nameOf(mem))));
+
+        PyRef mval(mem.type()==TypeCode::Struct && unpackrecurse ? asPyStruct(mem, true, wrapper)
+                                                                 : asPy(mem, unpackrecurse, true, wrapper));
+
+        if(isdict) {
+            if(PyDict_SetItem(mems.obj, key.obj, mval.obj))
+                throw std::runtime_error("XXX");
+
+        } else {
+            PyRef tup(PyTuple_Pack(2, key.obj, mval.obj));
+
+            if(PyList_Append(mems.obj, tup.obj))
+                throw std::runtime_error("XXX");
+        }
+    }
+
+    if(isdict || !wrapper || wrapper==Py_None)
+        return mems.release();
+    else
+        return PyObject_CallFunction(wrapper, "O", mems.obj);
+}
+
+
+// Unpack only marked fields of a Struct, and the sub-structures containing them.
+struct ChangedWalk {
+    const Value& top;
+    PyObject* wrapper;
+    std::set<std::string> marked;  // names relative to top
+    std::set<std::string> parents; // of marked fields
+
+    ChangedWalk(const Value& top, PyObject* wrapper)
+        :top(top)
+        ,wrapper(wrapper)
+    {
+        for(const auto& mem : top.imarked()) {
+            const auto& name = top.nameOf(mem);
+
+            bool insideMarked = false;
+            for(auto pos = name.find('.'); !insideMarked && pos!=std::string::npos; pos = name.find('.', pos+1)) {
+                // imarked() visits parents before children
+                auto prefix(name.substr(0, pos));
+                insideMarked = marked.count(prefix);
+                if(!insideMarked)
+                    parents.insert(prefix);
+            }
+
+            if(!insideMarked)
+                marked.insert(name);
+        }
+    }
+
+    PyObject* walk(const Value& v)
+    {
+        const bool isdict = wrapper==(PyObject*)&PyDict_Type;
+
+        PyRef mems(isdict ? PyDict_New() : PyList_New(0));
+
+        for(const auto &mem : v.ichildren()) {
+            const auto& name = top.nameOf(mem);
+
+            PyRef mval;
+            if(marked.count(name))
+                mval.reset(asPy(mem, true, true, wrapper));
+            else if(parents.count(name))
+                mval.reset(walk(mem));
+            else
+                continue;
+
+            auto key(PyRef::borrow(unpackKey(v.nameOf(mem))));
+
+            if(isdict) {
+                if(PyDict_SetItem(mems.obj, key.obj, mval.obj))
+                    throw std::runtime_error("XXX");
+
+            } else {
+                PyRef tup(PyTuple_Pack(2, key.obj, mval.obj));
+
+                if(PyList_Append(mems.obj, tup.obj))
+                    throw std::runtime_error("XXX");
+            }
+        }
+
+        if(isdict || !wrapper || wrapper==Py_None)
+            return mems.release();
+        else
+            return PyObject_CallFunction(wrapper, "O", mems.obj);
+    }
+};
+
+} // namespace
+
 PyObject* asPy(const Value& v, bool unpackstruct, bool unpackrecurse, PyObject* wrapper)
 {
     if(!v)
@@ -67,20 +201,7 @@ PyObject* asPy(const Value& v, bool unpackstruct, bool unpackrecurse, PyObject*
             return pvxs_pack(v);
 
         } else {
-            PyRef mems(PyList_New(0));
-
-            for(const auto &mem : v.ichildren()) {
-                PyRef mval(asPy(mem, unpackrecurse, true, wrapper));
-                PyRef tup(Py_BuildValue("sO", v.nameOf(mem).c_str(), mval.obj));
-
-                if(PyList_Append(mems.obj, tup.obj))
-                    throw std::runtime_error("XXX");
-            }
-
-            if(!wrapper || wrapper==Py_None)
-                return mems.release();
-            else
-                return PyObject_CallFunction(wrapper, "O", mems.obj);
+            return asPyStruct(v, unpackrecurse, wrapper);
         }
 
     } else if(v.type()==TypeCode::Union || v.type()==TypeCode::Any) {
@@ -166,6 +287,323 @@ PyObject* asPy(const Value& v, bool unpackstruct, bool unpackrecurse, PyObject*
     return pyarr.release();
 }
 
+// numpy type of scalar field
+static
+bool scalarNPY(TypeCode code, NPY_TYPES& ntype)
+{
+    switch(code.code) {
+#define CASE(NTYPE, PTYPE) case TypeCode::PTYPE: ntype = (NTYPE); return true
+    CASE(NPY_BOOL,   Bool);
+    CASE(NPY_INT8,   Int8);
+    CASE(NPY_INT16,  Int16);
+    CASE(NPY_INT32,  Int32);
+    CASE(NPY_INT64,  Int64);
+    CASE(NPY_UINT8,  UInt8);
+    CASE(NPY_UINT16, UInt16);
+    CASE(NPY_UINT32, UInt32);
+    CASE(NPY_UINT64, UInt64);
+    CASE(NPY_FLOAT,  Float32);
+    CASE(NPY_DOUBLE, Float64);
+#undef CASE
+    default:
+        return false;
+    }
+}
+
+#define FOREACH_NUMERIC(CASE) \
+    CASE(Bool, bool); \
+    CASE(Int8, int8_t); \
+    CASE(Int16, int16_t); \
+    CASE(Int32, int32_t); \
+    CASE(Int64, int64_t); \
+    CASE(UInt8, uint8_t); \
+    CASE(UInt16, uint16_t); \
+    CASE(UInt32, uint32_t); \
+    CASE(UInt64, uint64_t); \
+    CASE(Float32, float); \
+    CASE(Float64, double)
+
+namespace {
+struct Column {
+    TypeCode code;
+    PyRef col; // ndarray, or list for String
+    char* data = nullptr;
+};
+}
+
+PyObject* asPyColumns(const Value& v)
+{
+    if(v.type()!=TypeCode::StructA)
+        throw std::invalid_argument(SB()<<"Columnar conversion requires a struct array, not "<<v.type());
+
+    auto arr = v.as<shared_array<const Value>>();
+    auto proto = Value(v).allocMember();
+    npy_intp nrows = arr.size();
+
+    PyRef ret(PyDict_New());
+    std::vector<Column> cols;
+
+    for(const auto& mem : proto.ichildren()) {
+        Column col;
+        col.code = mem.type();
+        NPY_TYPES ntype;
+
+        if(col.code==TypeCode::String) {
+            col.col.reset(PyList_New(nrows));
+
+        } else if(scalarNPY(col.code, ntype)) {
+            col.col.reset(PyArray_ZEROS(1, &nrows, ntype, 0));
+            col.data = (char*)PyArray_DATA((PyArrayObject*)col.col.obj);
+
+        } else {
+            throw std::invalid_argument(SB()<<"Columnar conversion requires scalar members, not "
+                                        <<proto.nameOf(mem)<<" "<<mem.type());
+        }
+
+        if(PyDict_SetItemString(ret.obj, proto.nameOf(mem).c_str(), col.col.obj))
+            throw std::runtime_error("XXX");
+
+        cols.push_back(std::move(col));
+    }
+
+    for(npy_intp i=0; i<nrows; i++) {
+        auto cur = cols.begin();
+        // elements may be null
+        for(const auto& mem : arr[i] ? arr[i].ichildren() : proto.ichildren()) {
+            auto& col = *cur++;
+
+            switch(col.code.code) {
+#define CASE(CODE, CTYPE) case TypeCode::CODE: reinterpret_cast<CTYPE*>(col.data)[i] = mem.as<CTYPE>(); break
+            FOREACH_NUMERIC(CASE);
+#undef CASE
+            default: { // String
+                auto S = PyUnicode_FromString(mem.as<std::string>().c_str());
+                if(!S)
+                    throw std::runtime_error("XXX");
+                PyList_SET_ITEM(col.col.obj, i, S);
+            }
+            }
+        }
+    }
+
+    return ret.release();
+}
+
+// Share, rather than copy, the buffer of a 1-d numpy array of exactly the element type.
+// Limited to read-only arrays, and read-only views, of an immutable buffer.
+// eg. arrays returned by asPy(), which are already backed by a pvxs array, or by bytes.
+// A Value may be serialized later from a PVXS worker, so any buffer which python
+// could write through, including a read-only array owning its buffer, must be copied.
+static
+bool sharePy(shared_array<const void>& dest, PyObject* py, NPY_TYPES ntype, ArrayType atype)
+{
+    if(!PyArray_Check(py))
+        return false;
+
+    auto arr = (PyArrayObject*)py;
+
+    if(PyArray_NDIM(arr)!=1 || PyArray_TYPE(arr)!=ntype || PyArray_DIM(arr, 0)==0
+            || !PyArray_ISCARRAY_RO(arr) || PyArray_ISWRITEABLE(arr))
+        return false;
+
+    auto data = PyArray_DATA(arr);
+    size_t count = PyArray_DIM(arr, 0);
+
+    // numpy gives a view (eg. slice or ravel()) the parent ndarray as base.
+    // Follow through read-only parents to the owner of the buffer.
+    auto base = PyArray_BASE(arr);
+    while(base && PyArray_Check(base)) {
+        if(PyArray_ISWRITEABLE((PyArrayObject*)base))
+            return false;
+        base = PyArray_BASE((PyArrayObject*)base);
+    }
+
+    shared_array<const void> orig;
+    if(base && pvxs_unwrap_array(base, &orig)) {
+        // alias, possibly a slice of, the original
+        dest = shared_array<const void>(orig.dataPtr(), data, count, atype);
+
+    } else if(base && PyBytes_CheckExact(base)) {
+        // immutable buffer
+        Py_INCREF(py);
+        std::shared_ptr<const void> holder(data, [py](const void*) {
+            // may be released from a PVXS worker
+            if(Py_IsInitialized()) {
+                PyLock L;
+                Py_DECREF(py);
+            }
+        });
+        dest = shared_array<const void>(holder, data, count, atype);
+
+    } else {
+        return false;
+    }
+    return true;
+}
+
+PyObject* asPyStack(PyObject* values, const std::string& name)
+{
+    PyRef seq(PySequence_Fast(values, "Expected a sequence of Values"));
+    auto nrows = PySequence_Fast_GET_SIZE(seq.obj);
+
+    if(nrows==0) {
+        // nothing captured (yet).  Element type unknown, so use double
+        npy_intp zero = 0;
+        PyRef data(PyArray_ZEROS(1, &zero, NPY_DOUBLE, 0));
+        PyRef stamps(PyArray_ZEROS(1, &zero, NPY_DOUBLE, 0));
+        return Py_BuildValue("OO", data.obj, stamps.obj);
+    }
+
+    // first pass to find fields, and check types
+    std::vector<Value> tops(nrows), flds(nrows);
+    TypeCode code;
+    size_t ncols = 0u;
+
+    for(Py_ssize_t i=0; i<nrows; i++) {
+        auto item = PySequence_Fast_GET_ITEM(seq.obj, i);
+        if(!pvxs_isValue(item))
+            throw std::invalid_argument(SB()<<"Expected a sequence of Values, not "<<Py_TYPE(item)->tp_name);
+
+        tops[i] = pvxs_extract(item);
+        flds[i] = tops[i][name];
+        if(!flds[i])
+            throw LookupError(SB()<<"No field "<<name);
+
+        if(i==0)
+            code = flds[i].type();
+        else if(flds[i].type()!=code)
+            throw std::invalid_argument(SB()<<"Field "<<name<<" type "<<flds[i].type()<<" != "<<code);
+
+        if(code.isarray())
+            ncols = std::max(ncols, flds[i].as<shared_array<const void>>().size());
+    }
+
+    NPY_TYPES ntype;
+    if(!scalarNPY(code.isarray() ? code.scalarOf() : code, ntype))
+        throw std::invalid_argument(SB()<<"Stacking requires a numeric scalar or array field, not "<<code);
+
+    npy_intp shape[2] = {nrows, npy_intp(ncols)};
+    PyRef data(PyArray_ZEROS(code.isarray() ? 2 : 1, shape, ntype, 0));
+    PyRef stamps(PyArray_ZEROS(1, shape, NPY_DOUBLE, 0));
+
+    auto out = (char*)PyArray_DATA((PyArrayObject*)data.obj);
+    auto T = (double*)PyArray_DATA((PyArrayObject*)stamps.obj);
+    const auto esize = PyArray_ITEMSIZE((PyArrayObject*)data.obj);
+
+    for(Py_ssize_t i=0; i<nrows; i++) {
+        const auto& fld = flds[i];
+
+        if(code.isarray()) {
+            // shorter arrays are zero padded
+            auto arr(fld.as<shared_array<const void>>());
+            if(!arr.empty())
+                memcpy(out + i*ncols*esize, arr.data(), arr.size()*esize);
+
+        } else {
+            switch(code.code) {
+#define CASE(CODE, CTYPE) case TypeCode::CODE: reinterpret_cast<CTYPE*>(out)[i] = fld.as<CTYPE>(); break
+            FOREACH_NUMERIC(CASE);
+#undef CASE
+            default:
+                throw std::logic_error("logic error in stack");
+            }
+        }
+
+        auto sec(tops[i]["timeStamp.secondsPastEpoch"]);
+        auto nsec(tops[i]["timeStamp.nanoseconds"]);
+        if(sec && nsec)
+            T[i] = sec.as<double>() + nsec.as<double>()*1e-9;
+        else
+            T[i] = std::numeric_limits<double>::quiet_NaN();
+    }
+
+    return Py_BuildValue("OO", data.obj, stamps.obj);
+}
+
+PyObject* asPyNDArray(const Value& v)
+{
+    auto sel(v["value"].as<const Value>());
+    shared_array<const void> varr;
+    NPY_TYPES ntype = NPY_UINT8; // treat empty union as zero length char array
+
+    if(sel) {
+        if(!scalarNPY(sel.type().scalarOf(), ntype) || !sel.type().isarray())
+            throw std::invalid_argument(SB()<<"NTNDArray value must be a numeric array, not "<<sel.type());
+        varr = sel.as<shared_array<const void>>();
+    }
+
+    // dimension[0] is inner-most, so reverse for numpy
+    std::vector<npy_intp> shape;
+    size_t count = 1u;
+    if(auto dims = v["dimension"]) {
+        auto arr(dims.as<shared_array<const Value>>());
+        shape.resize(arr.size());
+        for(size_t i=0; i<arr.size(); i++) {
+            auto N(arr[i] ? arr[i]["size"].as<int64_t>() : 0);
+            if(N<0)
+                throw std::invalid_argument(SB()<<"NTNDArray dimension["<<i<<"].size negative");
+            shape[arr.size()-1u-i] = N;
+            count *= N;
+        }
+    }
+    if(shape.empty()) {
+        // can't reshape if 0-d, so treat as 1-d if no dimensions provided
+        shape.push_back(0);
+        count = 0u;
+    }
+
+    if(count!=varr.size()) {
+        PyErr_Format(PyExc_ValueError, "cannot reshape NTNDArray value of size %zu into %zu elements",
+                     varr.size(), count);
+        throw std::runtime_error("XXX");
+    }
+
+    PyRef pyarr;
+    if(!varr.data()) {
+        pyarr.reset(PyArray_ZEROS(shape.size(), shape.data(), ntype, 0));
+
+    } else {
+        PyRef holder(pvxs_wrap_array(varr));
+
+        pyarr.reset(PyArray_New(&PyArray_Type, shape.size(), shape.data(), ntype, nullptr,
+                                const_cast<void*>(varr.data()), // should not actually be modifiable
+                                0, NPY_ARRAY_CARRAY_RO, nullptr));
+
+#ifdef PyArray_SetBaseObject
+        PyArray_SetBaseObject((PyArrayObject*)pyarr.obj, holder.release());
+#else
+        ((PyArrayObject*)pyarr.obj)->base = holder.release();
+#endif
+    }
+
+    PyRef attrib(PyDict_New());
+    if(auto attrs = v["attribute"]) {
+        auto arr(attrs.as<shared_array<const Value>>());
+        for(const auto& elem : arr) {
+            if(!elem)
+                continue;
+            PyRef name(PyUnicode_FromString(elem["name"].as<std::string>().c_str()));
+            PyRef val(asPy(elem["value"], false, false, nullptr));
+
+            if(PyDict_SetItem(attrib.obj, name.obj, val.obj))
+                throw std::runtime_error("XXX");
+        }
+    }
+
+    return Py_BuildValue("OO", pyarr.obj, attrib.obj);
+}
+
+PyObject* asPyChanged(const Value& v, PyObject* wrapper)
+{
+    if(v.type()!=TypeCode::Struct)
+        throw std::invalid_argument(SB()<<"Changed field conversion requires a struct, not "<<v.type());
+
+    if(v.isMarked(true, false)) // all changed
+        return asPy(v, true, true, wrapper);
+
+    return ChangedWalk(v, wrapper).walk(v);
+}
+
 static
 Value inferPy(PyObject* py)
 {
@@ -266,6 +704,214 @@ Value inferPy(PyObject* py)
     return v;
 }
 
+namespace {
+
+// Index of long enum_t choice lists, by array storage.  Guarded by the GIL.
+struct ChoiceIndex {
+    std::weak_ptr<const std::string> storage;
+    const std::string* data;
+    size_t size;
+    std::unordered_map<std::string, size_t> index;
+};
+
+std::list<ChoiceIndex> choiceIndices; // most recently used first
+constexpr size_t maxChoiceIndices = 16u;
+constexpr size_t minIndexedChoices = 16u;
+
+bool findChoice(const shared_array<const std::string>& choices, const std::string& val, size_t& out)
+{
+    if(choices.size() < minIndexedChoices) {
+        for(size_t i=0, N=choices.size(); i<N; i++) {
+            if(choices[i]==val) {
+                out = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const auto& storage = choices.dataPtr();
+
+    auto it(choiceIndices.begin());
+    for(auto end(choiceIndices.end()); it!=end; ++it) {
+        // same allocation, and not a re-use of the same address
+        if(it->data==choices.data() && it->size==choices.size()
+                && !it->storage.owner_before(storage) && !storage.owner_before(it->storage))
+            break;
+    }
+
+    if(it==choiceIndices.end()) {
+        ChoiceIndex ent;
+        ent.storage = storage;
+        ent.data = choices.data();
+        ent.size = choices.size();
+        ent.index.reserve(choices.size());
+        for(size_t i=0, N=choices.size(); i<N; i++)
+            ent.index.emplace(choices[i], i); // first of any duplicates
+
+        choiceIndices.push_front(std::move(ent));
+        if(choiceIndices.size() > maxChoiceIndices)
+            choiceIndices.pop_back();
+
+    } else if(it!=choiceIndices.begin()) {
+        choiceIndices.splice(choiceIndices.begin(), choiceIndices, it);
+    }
+
+    auto& index = choiceIndices.front().index;
+    auto found(index.find(val));
+    if(found==index.end())
+        return false;
+    out = found->second;
+    return true;
+}
+
+} // namespace
+
+enum struct UnionMember {
+    Scalar,
+    NumArray,
+    Other,
+};
+
+// classify Union member for magic selection
+static
+UnionMember unionMemberKind(const Value& fld, NPY_TYPES& ntype)
+{
+    switch(fld.storageType()) {
+    case StoreType::Bool:
+    case StoreType::Real:
+    case StoreType::Integer:
+    case StoreType::UInteger:
+    case StoreType::String:
+        return UnionMember::Scalar;
+    case StoreType::Array:
+        if(scalarNPY(fld.type().scalarOf(), ntype))
+            return UnionMember::NumArray;
+        break;
+    default:
+        break;
+    }
+    return UnionMember::Other;
+}
+
+// dict key as field name
+static
+std::string fieldName(PyObject* key)
+{
+    PyRef temp;
+
+    if(PyUnicode_Check(key)) {
+#if PY_MAJOR_VERSION >= 3
+        // UTF-8 is cached by the str
+        Py_ssize_t len = 0;
+        auto S = PyUnicode_AsUTF8AndSize(key, &len);
+        if(!S)
+            throw std::runtime_error("XXX");
+        return std::string(S, len);
+#else
+        temp.reset(PyUnicode_AsUTF8String(key));
+        key = temp.obj;
+#endif
+    }
+
+    if(PyBytes_Check(key))
+        return std::string(PyBytes_AS_STRING(key), PyBytes_GET_SIZE(key));
+
+    PyErr_Format(PyExc_TypeError, "Field name must be str, not %s", Py_TYPE(key)->tp_name);
+    throw std::runtime_error("XXX");
+}
+
+// assign struct array from a dict of columns, or a numpy structured array
+static
+void storePyColumns(Value& v, PyObject* py)
+{
+    auto proto = v.allocMember();
+
+    // names available from a structured array
+    PyRef fields;
+    if(PyArray_Check(py)) {
+        fields.reset(PyObject_GetAttrString((PyObject*)PyArray_DESCR((PyArrayObject*)py), "fields"));
+    }
+
+    std::vector<Column> cols;
+    Py_ssize_t nrows = -1;
+    Py_ssize_t nfound = 0;
+
+    for(const auto& mem : proto.ichildren()) {
+        auto name(proto.nameOf(mem));
+        Column col;
+        col.code = mem.type();
+
+        PyObject* pycol = nullptr;
+        PyRef temp;
+        if(fields) {
+            if(PyMapping_HasKeyString(fields.obj, const_cast<char*>(name.c_str()))) {
+                temp.reset(PyObject_GetItem(py, PyRef(PyUnicode_FromString(name.c_str())).obj));
+                pycol = temp.obj;
+            }
+        } else {
+            pycol = PyDict_GetItemString(py, name.c_str()); // borrowed
+        }
+
+        NPY_TYPES ntype;
+        if(!pycol) {
+            // leave default
+
+        } else if(col.code==TypeCode::String) {
+            col.col.reset(PySequence_Fast(pycol, "String column must be a sequence"));
+
+        } else if(scalarNPY(col.code, ntype)) {
+            col.col.reset(PyArray_FromAny(pycol, PyArray_DescrFromType(ntype), 1, 1,
+                                          NPY_ARRAY_CARRAY_RO|NPY_ARRAY_FORCECAST, nullptr));
+            col.data = (char*)PyArray_DATA((PyArrayObject*)col.col.obj);
+
+        } else {
+            throw std::invalid_argument(SB()<<"Columnar assignment requires scalar members, not "
+                                        <<name<<" "<<mem.type());
+        }
+
+        if(col.col) {
+            nfound++;
+            auto len = col.data ? PyArray_DIM((PyArrayObject*)col.col.obj, 0) : PySequence_Fast_GET_SIZE(col.col.obj);
+            if(nrows==-1) {
+                nrows = len;
+            } else if(nrows!=len) {
+                PyErr_Format(PyExc_ValueError, "Column %s length %zd != %zd", name.c_str(), len, nrows);
+                throw std::runtime_error("XXX");
+            }
+        }
+
+        cols.push_back(std::move(col));
+    }
+
+    auto ncols = PyMapping_Size(fields ? fields.obj : py);
+    if(nfound!=ncols)
+        throw LookupError(SB()<<"Column names do not match members of "<<v.type());
+
+    shared_array<Value> arr(std::max(nrows, Py_ssize_t(0)));
+
+    for(size_t i=0; i<arr.size(); i++) {
+        arr[i] = v.allocMember();
+
+        auto cur = cols.begin();
+        for(auto fld : arr[i].ichildren()) {
+            auto& col = *cur++;
+            if(!col.col)
+                continue;
+
+            switch(col.code.code) {
+#define CASE(CODE, CTYPE) case TypeCode::CODE: fld.from(reinterpret_cast<const CTYPE*>(col.data)[i]); break
+            FOREACH_NUMERIC(CASE);
+#undef CASE
+            default: // String
+                storePy(fld, PySequence_Fast_GET_ITEM(col.col.obj, i), true);
+            }
+        }
+    }
+
+    v = arr.freeze();
+}
+
 void storePy(Value& v, PyObject* py, bool forceCast)
 {
     if(!v)
@@ -350,12 +996,10 @@ void storePy(Value& v, PyObject* py, bool forceCast)
                     }
 
                     // attempt choice lookup
-                    for(size_t i=0, N=choices.size(); i<N; i++) {
-                        if(choices[i]==val) {
-                            index.from<uint64_t>(i);
-                            found = true;
-                            break;
-                        }
+                    size_t i;
+                    if(findChoice(choices, val, i)) {
+                        index.from<uint64_t>(i);
+                        found = true;
                     }
                 }
 
@@ -366,11 +1010,18 @@ void storePy(Value& v, PyObject* py, bool forceCast)
                 return;
 
             } else {
-                PyRef items;
-
                 if(PyDict_Check(py)) {
-                    items.reset(PyDict_Items(py));
-                    py = items.obj;
+                    // iterate in place, without a list of item tuples
+                    Py_ssize_t pos = 0;
+                    PyObject *key, *val;
+
+                    while(PyDict_Next(py, &pos, &key, &val)) {
+                        auto hold(PyRef::borrow(val));
+
+                        auto sub(v.lookup(fieldName(key)));
+                        storePy(sub, val, forceCast);
+                    }
+                    return;
                 }
 
                 PyRef iter(PyObject_GetIter(py));
@@ -414,10 +1065,39 @@ void storePy(Value& v, PyObject* py, bool forceCast)
             } else {
                 // attempt "magic" selection.  (aka try each field until assignment succeeds...)
 
+                // skip fields where assignment must fail, without the cost of an exception
+                const bool pyarray = PyArray_Check(py);
+                const bool pyscalar = !pyarray && (PyBool_Check(py) || PyLong_Check(py) || PyFloat_Check(py)
+#if PY_MAJOR_VERSION < 3
+                                                   || PyInt_Check(py)
+#endif
+                                                   || PyBytes_Check(py) || PyUnicode_Check(py)
+                                                   || PyArray_IsScalar(py, Generic));
+
+                if(pyarray && PyArray_NDIM((PyArrayObject*)py)==1) {
+                    // prefer an array field of exactly the element type
+                    for(auto fld : v.iall()) {
+                        NPY_TYPES ntype;
+                        if(unionMemberKind(fld, ntype)==UnionMember::NumArray && PyArray_TYPE((PyArrayObject*)py)==ntype) {
+                            storePy(fld, py, false);
+
+                            auto name(v.nameOf(fld));
+                            v["->"+name].assign(fld);
+                            return;
+                        }
+                    }
+                }
+
                 for(auto fld : v.iall()) {
                     if(PyErr_Occurred())
                         PyErr_Clear();
 
+                    NPY_TYPES ntype;
+                    auto kind(unionMemberKind(fld, ntype));
+                    if((pyscalar && kind==UnionMember::NumArray) // only 1-d array can be assigned
+                            || (pyarray && kind==UnionMember::Scalar)) // can't assign scalar with array
+                        continue;
+
                     // note that fld may be temporary storage
                     try {
                         storePy(fld, py, false);
@@ -445,7 +1125,12 @@ void storePy(Value& v, PyObject* py, bool forceCast)
         break;
 
     case StoreType::Array: {
-        if(v.type()==TypeCode::StructA || v.type()==TypeCode::UnionA) {
+        if(v.type()==TypeCode::StructA && (PyDict_Check(py) ||
+                                           (PyArray_Check(py) && PyDataType_HASFIELDS(PyArray_DESCR((PyArrayObject*)py))))) {
+            storePyColumns(v, py);
+            return;
+
+        } else if(v.type()==TypeCode::StructA || v.type()==TypeCode::UnionA) {
 
             if(!PySequence_Check(py))
                 throw std::runtime_error(SB()<<"Must assign sequence to struct/union array, not "<<Py_TYPE(py)->tp_name);
@@ -525,6 +1210,12 @@ void storePy(Value& v, PyObject* py, bool forceCast)
                 throw std::logic_error(SB()<<"logic error in array Value assignment for "<<v.type());
             }
 
+            shared_array<const void> shared;
+            if(sharePy(shared, py, ntype, v.type().arrayType())) {
+                v = shared;
+                return;
+            }
+
             PyRef arr(PyArray_FromAny(py, PyArray_DescrFromType(ntype), 0, 0,
                                       NPY_ARRAY_CARRAY_RO|NPY_ARRAY_FORCECAST, nullptr));
 
@@ -547,6 +1238,138 @@ void storePy(Value& v, PyObject* py, bool forceCast)
     throw std::invalid_argument(SB()<<"Can't assign "<<v.type()<<" field from "<<Py_TYPE(py)->tp_name);
 }
 
+namespace {
+// bound on the number of plans cached by each Type
+constexpr Py_ssize_t maxAssignPlans = 64;
+
+// Plan assignment of a Struct from a dict with these keys.
+// A flat tuple of (iall() position, key index) pairs, in order of position.
+// None when keys overlap (eg. 'alarm' and 'alarm.severity'), so dict order must be kept.
+PyObject* buildAssignPlan(Value& v, PyObject* keys)
+{
+    auto nkeys(PyTuple_GET_SIZE(keys));
+
+    std::map<std::string, size_t> positions;
+    {
+        size_t i = 0u;
+        for(auto fld : v.iall())
+            positions[v.nameOf(fld)] = i++;
+    }
+
+    std::set<std::string> names;
+    std::vector<std::pair<size_t, Py_ssize_t>> steps(nkeys);
+
+    for(Py_ssize_t i=0; i<nkeys; i++) {
+        auto name(fieldName(PyTuple_GET_ITEM(keys, i)));
+        (void)v.lookup(name); // throws LookupError if no such field
+
+        auto it(positions.find(name));
+        if(it==positions.end() || !names.insert(name).second)
+            return PyRef::borrow(Py_None).release();
+        steps[i] = std::make_pair(it->second, i);
+    }
+
+    for(const auto& name : names) {
+        for(auto sep = name.find('.'); sep!=std::string::npos; sep = name.find('.', sep+1u)) {
+            if(names.count(name.substr(0u, sep)))
+                return PyRef::borrow(Py_None).release();
+        }
+    }
+
+    std::sort(steps.begin(), steps.end());
+
+    PyRef ret(PyTuple_New(2*nkeys));
+    for(Py_ssize_t i=0; i<nkeys; i++) {
+        PyTuple_SET_ITEM(ret.obj, 2*i, PyRef(PyLong_FromSize_t(steps[i].first)).release());
+        PyTuple_SET_ITEM(ret.obj, 2*i+1, PyRef(PyLong_FromSsize_t(steps[i].second)).release());
+    }
+    return ret.release();
+}
+} // namespace
+
+size_t fieldIndex(const Value& top, const std::string& name)
+{
+    auto mem(top.lookup(name)); // throws LookupError
+
+    size_t idx = 0u;
+    for(auto fld : top.iall()) {
+        if(fld.equalInst(mem))
+            return idx;
+        idx++;
+    }
+    return fieldNoIndex;
+}
+
+Value fieldAt(const Value& top, size_t index)
+{
+    // advancing an iall() iterator only increments a position
+    auto all(top.iall());
+    auto it(all.begin());
+    for(; index; index--)
+        ++it;
+    return *it;
+}
+
+void storePyPlanned(Value& v, PyObject* py, PyObject* plans)
+{
+    if(!plans || !PyDict_Check(plans) || !PyDict_CheckExact(py) || v.type()!=TypeCode::Struct || PyDict_Size(py)==0) {
+        storePy(v, py, true);
+        return;
+    }
+
+    auto nkeys(PyDict_Size(py));
+    // hold references as assignment may run python code
+    PyRef keys(PyTuple_New(nkeys)), vals(PyTuple_New(nkeys));
+    {
+        Py_ssize_t pos = 0, i = 0;
+        PyObject *key, *val;
+        while(PyDict_Next(py, &pos, &key, &val)) {
+            Py_INCREF(key);
+            PyTuple_SET_ITEM(keys.obj, i, key);
+            Py_INCREF(val);
+            PyTuple_SET_ITEM(vals.obj, i, val);
+            i++;
+        }
+    }
+
+    PyRef plan;
+    if(auto cached = PyDict_GetItem(plans, keys.obj)) {
+        plan = PyRef::borrow(cached);
+
+    } else {
+        plan.reset(buildAssignPlan(v, keys.obj));
+
+        if(PyDict_Size(plans) >= maxAssignPlans)
+            PyDict_Clear(plans);
+        if(PyDict_SetItem(plans, keys.obj, plan.obj))
+            throw std::runtime_error("XXX");
+    }
+
+    if(plan.obj==Py_None) {
+        storePy(v, py, true);
+        return;
+    }
+
+    // one walk of the fields, instead of a lookup by name for each key
+    const auto nsteps(PyTuple_GET_SIZE(plan.obj));
+    Py_ssize_t step = 0;
+    size_t next = PyLong_AsSize_t(PyTuple_GET_ITEM(plan.obj, 0));
+    size_t idx = 0u;
+
+    for(auto fld : v.iall()) {
+        if(idx++ != next)
+            continue;
+
+        auto slot(PyLong_AsSsize_t(PyTuple_GET_ITEM(plan.obj, step+1)));
+        storePy(fld, PyTuple_GET_ITEM(vals.obj, slot), true);
+
+        step += 2;
+        if(step>=nsteps)
+            break;
+        next = PyLong_AsSize_t(PyTuple_GET_ITEM(plan.obj, step));
+    }
+}
+
 namespace {
 
 